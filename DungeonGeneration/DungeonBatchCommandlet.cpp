@@ -0,0 +1,376 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DungeonBatchCommandlet.h"
+#include "DungeonGenerator.h"
+#include "DungeonLayoutCache.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "Tasks/Task.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+UDungeonBatchCommandlet::UDungeonBatchCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+/*
+ * @brief Generate the requested seeds for every generator and write the results
+ * @param const FString& Params Command line of the commandlet
+ * @return int32 0 if every generation succeeded
+ */
+int32 UDungeonBatchCommandlet::Main(const FString& Params)
+{
+	FString generatorList;
+	if(!FParse::Value(*Params, TEXT("Generators="), generatorList, false))
+	{
+		UE_LOG(LogTemp, Error, TEXT("DungeonBatch needs -Generators=<Class path>,<Class path>"));
+		return 1;
+	}
+
+	FParse::Value(*Params, TEXT("Seeds="), SeedCount);
+	FParse::Value(*Params, TEXT("FirstSeed="), FirstSeed);
+	FParse::Value(*Params, TEXT("RoomCount="), RoomCount);
+
+	WorkerCount = FMath::Max(FTaskGraphInterface::Get().GetNumWorkerThreads(), 1);
+	FParse::Value(*Params, TEXT("Workers="), WorkerCount);
+	WorkerCount = FMath::Max(WorkerCount, 1);
+	SeedCount = FMath::Max(SeedCount, 0);
+	ShouldWriteLayouts = !FParse::Param(*Params, TEXT("NoLayouts"));
+
+	if(!FParse::Value(*Params, TEXT("Output="), OutputDir))
+	{
+		OutputDir = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("DungeonBatch"));
+	}
+	IFileManager::Get().MakeDirectory(*OutputDir, true);
+
+	FString sweep;
+	FParse::Value(*Params, TEXT("Sweep="), sweep, false);
+	TArray<FDungeonBatchConfig> configs;
+	if(!ParseSweep(sweep, configs))
+		return 1;
+
+	TArray<FString> generatorPaths;
+	generatorList.ParseIntoArray(generatorPaths, TEXT(","));
+
+	// Every generator is a parameter set, its defaults come from the Blueprint
+	bool allSucceeded = true;
+	TArray<FDungeonBatchResult> results;
+	for(auto& generatorPath : generatorPaths)
+	{
+		UClass* generatorClass = LoadClass<ADungeonGenerator>(nullptr, *generatorPath.TrimStartAndEnd());
+		if(!generatorClass)
+		{
+			UE_LOG(LogTemp, Error, TEXT("Generator class %s could not be loaded!"), *generatorPath);
+			allSucceeded = false;
+			continue;
+		}
+
+		for(auto& config : configs)
+		{
+			UE_LOG(LogTemp, Display, TEXT("Generating %d seeds with %s [%s] on %d workers"), SeedCount, *generatorClass->GetName(), *config.Label, WorkerCount);
+			allSucceeded &= RunGenerator(generatorClass, config, results);
+		}
+	}
+
+	if(!WriteReport(results))
+		return 1;
+
+	if(!WriteSummary(results))
+		return 1;
+
+	return allSucceeded ? 0 : 1;
+}
+
+/*
+ * @brief Build every combination of the swept property values
+ * @param const FString& sweep e.g. "LoopProbability=0.1|0.3;IsRoomProcGen=True|False"
+ * @param TArray<FDungeonBatchConfig>& configs A single default config without a sweep
+ * @return bool False if the sweep is malformed
+ */
+bool UDungeonBatchCommandlet::ParseSweep(const FString& sweep, TArray<FDungeonBatchConfig>& configs) const
+{
+	configs.Reset();
+	configs.AddDefaulted();
+
+	TArray<FString> axes;
+	sweep.ParseIntoArray(axes, TEXT(";"));
+	for(auto& axis : axes)
+	{
+		FString name, values;
+		TArray<FString> valueList;
+		if(!axis.Split(TEXT("="), &name, &values) || values.ParseIntoArray(valueList, TEXT("|")) == 0)
+		{
+			UE_LOG(LogTemp, Error, TEXT("Sweep axis %s needs the form <Property>=<Value>|<Value>!"), *axis);
+			return false;
+		}
+
+		TArray<FDungeonBatchConfig> combined;
+		for(auto& config : configs)
+		{
+			for(auto& value : valueList)
+			{
+				FDungeonBatchConfig& newConfig = combined.Add_GetRef(config);
+				newConfig.Overrides.Emplace(name.TrimStartAndEnd(), value.TrimStartAndEnd());
+			}
+		}
+		configs = MoveTemp(combined);
+	}
+
+	// Labels are CSV columns, struct values contain commas
+	for(auto& config : configs)
+	{
+		TArray<FString> parts;
+		for(auto& override : config.Overrides)
+		{
+			parts.Add(override.Key + TEXT("=") + override.Value.Replace(TEXT(","), TEXT(" ")));
+		}
+		config.Label = parts.IsEmpty() ? TEXT("Default") : FString::Join(parts, TEXT(" "));
+	}
+	
+	return true;
+}
+
+/*
+ * @brief Generate every seed with one generator class, each worker owns a generator
+ * @param TSubclassOf<ADungeonGenerator> generatorClass
+ * @param const FDungeonBatchConfig& config Properties changed from the class defaults
+ * @param TArray<FDungeonBatchResult>& results Results are appended
+ * @return bool False if a generation failed
+ */
+bool UDungeonBatchCommandlet::RunGenerator(TSubclassOf<ADungeonGenerator> generatorClass, const FDungeonBatchConfig& config, TArray<FDungeonBatchResult>& results) const
+{
+	// The generators are never spawned, only the data stages run so they don't need a world
+	TArray<ADungeonGenerator*> generators;
+	bool isConfigValid = true;
+	for(int i = 0; i<FMath::Min(WorkerCount, SeedCount) && isConfigValid; ++i)
+	{
+		ADungeonGenerator* generator = NewObject<ADungeonGenerator>(GetTransientPackage(), generatorClass, NAME_None, RF_Transient);
+		generator->AddToRoot();
+		generators.Add(generator);
+
+		for(auto& override : config.Overrides)
+		{
+			const FProperty* property = FindFProperty<FProperty>(generatorClass, *override.Key);
+			if(!property || !property->ImportText_InContainer(*override.Value, generator, generator, PPF_None))
+			{
+				UE_LOG(LogTemp, Error, TEXT("Property %s can't be set to %s!"), *override.Key, *override.Value);
+				isConfigValid = false;
+				break;
+			}
+		}
+	}
+
+	if(!isConfigValid)
+	{
+		for(auto& generator : generators)
+		{
+			generator->RemoveFromRoot();
+		}
+		return false;
+	}
+
+	const FString generatorName = generatorClass->GetName();
+	const FString layoutDir = FPaths::Combine(OutputDir, TEXT("Layouts"), generatorName);
+	const FTransform startingPoint = FTransform::Identity;
+
+	bool allSucceeded = true;
+	TArray<UE::Tasks::FTask> tasks;
+	TArray<bool> isComplete;
+	for(int batchStart = 0; batchStart<SeedCount; batchStart += generators.Num())
+	{
+		const int batchSize = FMath::Min(generators.Num(), SeedCount - batchStart);
+
+		// Prefab defaults are cached on the game thread, the stages run on the workers
+		tasks.Reset();
+		isComplete.Init(false, batchSize);
+		for(int i = 0; i<batchSize; ++i)
+		{
+			ADungeonGenerator* generator = generators[i];
+			generator->BeginHeadlessGeneration(startingPoint, RoomCount, FirstSeed + batchStart + i);
+			tasks.Add(UE::Tasks::Launch(UE_SOURCE_LOCATION, [generator, &isComplete, i]()
+			{
+				isComplete[i] = generator->RunHeadlessGeneration();
+			}));
+		}
+		UE::Tasks::Wait(tasks);
+
+		for(int i = 0; i<batchSize; ++i)
+		{
+			const ADungeonGenerator* generator = generators[i];
+			const FDungeonLayout& layout = generator->GetLayout();
+
+			FDungeonBatchResult& result = results.AddDefaulted_GetRef();
+			result.Generator = generatorName;
+			result.Config = config.Label;
+			result.Seed = FirstSeed + batchStart + i;
+			const FDungeonLayoutCacheKey layoutKey = generator->ComputeLayoutCacheKey(startingPoint, RoomCount);
+			result.LayoutKey = layoutKey.Hash;
+			result.RoomCount = layout.Rooms.Num();
+			result.HallwayCount = layout.HallwayPaths.Num();
+			result.FailedHallwayCount = generator->GetFailedHallwayCount();
+			result.StageSeconds = generator->GetStageSeconds();
+			result.MemoryBytes = generator->GetGenerationMemory();
+			result.PieceCount = layout.Rooms.Num() + layout.HallwayCells.Num() + layout.Stairs.Num()
+				+ layout.Ceilings.Num() + layout.Walls.Num() + layout.Doors.Num();
+
+			const FPathfinderStats& pathStats = generator->GetPathfinderStats();
+			result.PathQueryCount = pathStats.GetQueryCount();
+			result.MeanExpansions = pathStats.Expansions.GetMean();
+			result.MaxExpansions = pathStats.Expansions.Max;
+			result.MeanStalePops = pathStats.StalePops.GetMean();
+			result.SlowestPathMs = pathStats.Microseconds.Max * 0.001;
+
+			if(!isComplete[i])
+				result.FailureReason = TEXT("Generation stopped before the layout was complete");
+			else if(layout.Rooms.IsEmpty())
+				result.FailureReason = TEXT("Entrance room could not be placed");
+			else if(layout.Rooms.Num() == 1)
+				result.FailureReason = TEXT("No room besides the entrance could be placed");
+			else if(result.FailedHallwayCount > 0)
+				result.FailureReason = FString::Printf(TEXT("%d of %d hallways could not be routed"), result.FailedHallwayCount, result.HallwayCount);
+
+			result.Success = result.FailureReason.IsEmpty();
+			if(!result.Success)
+			{
+				UE_LOG(LogTemp, Warning, TEXT("%s seed %d: %s"), *generatorName, result.Seed, *result.FailureReason);
+				allSucceeded = false;
+			}
+
+			// Layouts use the cache format, named by key they can be copied into the cache as they are
+			if(ShouldWriteLayouts && isComplete[i])
+			{
+				const FString layoutPath = FPaths::Combine(layoutDir, FString::Printf(TEXT("%08x.dlay"), result.LayoutKey));
+				if(!FDungeonLayoutCache::SaveToFile(layout, layoutKey, layoutPath))
+				{
+					UE_LOG(LogTemp, Error, TEXT("Failed to write the layout %s!"), *layoutPath);
+				}
+			}
+		}
+	}
+
+	for(auto& generator : generators)
+	{
+		generator->RemoveFromRoot();
+	}
+
+	return allSucceeded;
+}
+
+/*
+ * @brief Write the results as CSV, one row per generation with a column per stage
+ * @param const TArray<FDungeonBatchResult>& results
+ * @return bool True if the report was written
+ */
+bool UDungeonBatchCommandlet::WriteReport(const TArray<FDungeonBatchResult>& results) const
+{
+	const UEnum* stageEnum = StaticEnum<EDungeonGenerationStage>();
+	const int stageCount = static_cast<int32>(EDungeonGenerationStage::DONE) + 1;
+
+	FString report = TEXT("Generator,Config,Seed,LayoutKey,Success,Rooms,Hallways,FailedHallways,FailureReason,MemoryKB,Pieces,PathQueries,MeanExpansions,MaxExpansions,MeanStalePops,SlowestPathMs");
+	for(int stage = 0; stage<stageCount; ++stage)
+	{
+		report += FString::Printf(TEXT(",%sMs"), *stageEnum->GetNameStringByValue(stage));
+	}
+	report += LINE_TERMINATOR;
+
+	for(auto& result : results)
+	{
+		report += FString::Printf(TEXT("%s,%s,%d,%08x,%d,%d,%d,%d,\"%s\""),
+			*result.Generator, *result.Config, result.Seed, result.LayoutKey, result.Success ? 1 : 0,
+			result.RoomCount, result.HallwayCount, result.FailedHallwayCount, *result.FailureReason);
+		report += FString::Printf(TEXT(",%.1f,%d,%d,%.1f,%.0f,%.1f,%.3f"),
+			result.MemoryBytes / 1024.0, result.PieceCount, result.PathQueryCount, result.MeanExpansions, result.MaxExpansions, result.MeanStalePops, result.SlowestPathMs);
+
+		for(int stage = 0; stage<stageCount; ++stage)
+		{
+			const double seconds = result.StageSeconds.IsValidIndex(stage) ? result.StageSeconds[stage] : 0.0;
+			report += FString::Printf(TEXT(",%.3f"), seconds * 1000.0);
+		}
+		report += LINE_TERMINATOR;
+	}
+
+	const FString reportPath = FPaths::Combine(OutputDir, TEXT("DungeonBatch.csv"));
+	if(!FFileHelper::SaveStringToFile(report, *reportPath))
+	{
+		UE_LOG(LogTemp, Error, TEXT("Failed to write the batch report %s!"), *reportPath);
+		return false;
+	}
+
+	UE_LOG(LogTemp, Display, TEXT("Wrote %d results to %s"), results.Num(), *reportPath);
+	return true;
+}
+
+/*
+ * @brief Write the mean timings of every generator and configuration
+ * @param const TArray<FDungeonBatchResult>& results
+ * @return bool False if the summary couldn't be written
+ */
+bool UDungeonBatchCommandlet::WriteSummary(const TArray<FDungeonBatchResult>& results) const
+{
+	const UEnum* stageEnum = StaticEnum<EDungeonGenerationStage>();
+	const int stageCount = static_cast<int32>(EDungeonGenerationStage::DONE) + 1;
+
+	TMap<FString, TArray<const FDungeonBatchResult*>> groups;
+	for(auto& result : results)
+	{
+		groups.FindOrAdd(result.Generator + TEXT(",") + result.Config).Add(&result);
+	}
+
+	FString summary = TEXT("Generator,Config,Seeds,Succeeded,MeanTotalMs");
+	for(int stage = 0; stage<stageCount; ++stage)
+	{
+		summary += FString::Printf(TEXT(",%sMeanMs"), *stageEnum->GetNameStringByValue(stage));
+	}
+	summary += TEXT(",PeakMemoryKB,MeanPieces,MaxPieces");
+	summary += LINE_TERMINATOR;
+
+	for(auto& group : groups)
+	{
+		const TArray<const FDungeonBatchResult*>& groupResults = group.Value;
+		
+		TArray<double> stageMs;
+		stageMs.SetNumZeroed(stageCount);
+		int succeeded = 0;
+		double peakMemoryKB = 0.0;
+		double pieceSum = 0.0;
+		int maxPieces = 0;
+		for(const FDungeonBatchResult* result : groupResults)
+		{
+			for(int stage = 0; stage<stageCount && stage<result->StageSeconds.Num(); ++stage)
+			{
+				stageMs[stage] += result->StageSeconds[stage] * 1000.0 / groupResults.Num();
+			}
+			succeeded += result->Success ? 1 : 0;
+			peakMemoryKB = FMath::Max(peakMemoryKB, result->MemoryBytes / 1024.0);
+			pieceSum += result->PieceCount;
+			maxPieces = FMath::Max(maxPieces, result->PieceCount);
+		}
+
+		double totalMs = 0.0;
+		for(const double ms : stageMs)
+		{
+			totalMs += ms;
+		}
+
+		summary += FString::Printf(TEXT("%s,%d,%d,%.3f"), *group.Key, groupResults.Num(), succeeded, totalMs);
+		for(const double ms : stageMs)
+		{
+			summary += FString::Printf(TEXT(",%.3f"), ms);
+		}
+		summary += FString::Printf(TEXT(",%.1f,%.1f,%d"), peakMemoryKB, pieceSum / groupResults.Num(), maxPieces);
+		summary += LINE_TERMINATOR;
+	}
+
+	const FString summaryPath = FPaths::Combine(OutputDir, TEXT("DungeonBatchSummary.csv"));
+	if(!FFileHelper::SaveStringToFile(summary, *summaryPath))
+	{
+		UE_LOG(LogTemp, Error, TEXT("Failed to write the batch summary %s!"), *summaryPath);
+		return false;
+	}
+
+	UE_LOG(LogTemp, Display, TEXT("Wrote %d configurations to %s"), groups.Num(), *summaryPath);
+	return true;
+}
@@ -0,0 +1,85 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "DungeonBatchCommandlet.generated.h"
+
+class ADungeonGenerator;
+
+// Property values applied on top of the generator defaults
+struct FDungeonBatchConfig
+{
+	FString Label;
+	TArray<TPair<FString, FString>> Overrides;
+};
+
+// Result of one seed of one generator
+struct FDungeonBatchResult
+{
+	FString Generator;
+	FString Config;
+	int Seed = 0;
+	uint32 LayoutKey = 0;
+	bool Success = false;
+	FString FailureReason;
+	int RoomCount = 0;
+	int HallwayCount = 0;
+	int FailedHallwayCount = 0;
+	TArray<double> StageSeconds;
+
+	// Size of the result, the pieces are the actors materializing would spawn
+	SIZE_T MemoryBytes = 0;
+	int PieceCount = 0;
+
+	// Hallway searches
+	int PathQueryCount = 0;
+	double MeanExpansions = 0.0;
+	double MaxExpansions = 0.0;
+	double MeanStalePops = 0.0;
+	double SlowestPathMs = 0.0;
+};
+
+/**
+ * Generates layouts for many seeds and generator setups without a world, runs under -nullrhi
+ *
+ * UnrealEditor-Cmd <Project> -run=DungeonBatch -nullrhi
+ *		-Generators=/Game/BP_Generator.BP_Generator_C,/Game/BP_Tower.BP_Tower_C
+ *		-Seeds=100 -FirstSeed=0 -RoomCount=20 -Workers=8 -Output=<Dir> -NoLayouts
+ *
+ * Sweeps run every combination of the listed values, each with the same seeds:
+ *		-Sweep="DungeonSize=(X=30,Y=30,Z=5)|(X=60,Y=60,Z=5);LoopProbability=0.1|0.3;IsRoomProcGen=True|False"
+ *
+ * The workers run concurrently so the timings show throughput, the DungeonGeneration.Benchmark automation tests time single generations
+ */
+UCLASS()
+class NETWORKINGPROTOTYPE_API UDungeonBatchCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UDungeonBatchCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+private:
+	// Build the combinations of the sweep, returns false on a malformed sweep
+	bool ParseSweep(const FString& sweep, TArray<FDungeonBatchConfig>& configs) const;
+
+	// Generate every seed with one generator setup, returns false if a generation failed
+	bool RunGenerator(TSubclassOf<ADungeonGenerator> generatorClass, const FDungeonBatchConfig& config, TArray<FDungeonBatchResult>& results) const;
+
+	// Write one row per generation and the per-stage timings
+	bool WriteReport(const TArray<FDungeonBatchResult>& results) const;
+
+	// Write one row per generator and configuration
+	bool WriteSummary(const TArray<FDungeonBatchResult>& results) const;
+
+	int SeedCount = 1;
+	int FirstSeed = 0;
+	int RoomCount = 20;
+	int WorkerCount = 1;
+	bool ShouldWriteLayouts = true;
+	FString OutputDir;
+};
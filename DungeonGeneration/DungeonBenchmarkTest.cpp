@@ -0,0 +1,323 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DungeonGenerator.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "HAL/PlatformMemory.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/AutomationTest.h"
+#include "Misc/CommandLine.h"
+#include "Misc/ConfigCacheIni.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+/*
+ * Full generations, materialize included, timed one at a time in a fresh game world.
+ * The generator class comes from -DungeonBenchmarkGenerator=<Class path> or Generator in the
+ * [DungeonBenchmark] section of the game config. Every sweep case writes
+ * Saved/DungeonBenchmark/<Case>.csv and fails if it regressed against the file with the same name in
+ * -DungeonBenchmarkBaseline=<Dir> by more than -DungeonBenchmarkThreshold=<Fraction>
+ */
+IMPLEMENT_COMPLEX_AUTOMATION_TEST(FDungeonBenchmarkTest, "DungeonGeneration.Benchmark",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::ClientContext | EAutomationTestFlags::PerfFilter)
+
+namespace DungeonBenchmark
+{
+	const TCHAR* ConfigSection = TEXT("DungeonBenchmark");
+
+	struct FSample
+	{
+		double TotalMs = 0;
+		TArray<double> StageMs;
+		int64 GenerationMemoryKB = 0;
+		int64 ProcessMemoryDeltaKB = 0;
+		int64 ProcessPeakKB = 0;
+		int ActorCount = 0;
+		int RoomCount = 0;
+	};
+
+	/*
+	 * @brief Read a setting from the command line, the game config is the fallback
+	 * @param const TCHAR* name Command line switch without the dash, the config key drops the DungeonBenchmark prefix
+	 * @param FString& value Unchanged if the setting is missing
+	 */
+	void ReadSetting(const TCHAR* name, FString& value)
+	{
+		if(!FParse::Value(FCommandLine::Get(), *FString::Printf(TEXT("DungeonBenchmark%s="), name), value))
+		{
+			GConfig->GetString(ConfigSection, name, value, GGameIni);
+		}
+	}
+
+	/*
+	 * @brief Set a generator property from its text form, the properties are private to blueprints
+	 * @param ADungeonGenerator* generator
+	 * @param const FString& name
+	 * @param const FString& value
+	 * @return bool False if the property doesn't exist or the value doesn't parse
+	 */
+	bool SetProperty(ADungeonGenerator* generator, const FString& name, const FString& value)
+	{
+		const FProperty* property = FindFProperty<FProperty>(generator->GetClass(), *name);
+		return property && property->ImportText_InContainer(*value, generator, generator, PPF_None);
+	}
+
+	int CountActors(UWorld* world)
+	{
+		int count = 0;
+		for(TActorIterator<AActor> it(world); it; ++it)
+		{
+			++count;
+		}
+		return count;
+	}
+
+	/*
+	 * @brief Mean of each named column of a benchmark csv
+	 * @param const FString& path
+	 * @param const TArray<FString>& columns
+	 * @param TArray<double>& means Same order as the columns
+	 * @return bool False if the file is missing, has no samples or lacks a column
+	 */
+	bool ReadMeans(const FString& path, const TArray<FString>& columns, TArray<double>& means)
+	{
+		TArray<FString> lines;
+		if(!FFileHelper::LoadFileToStringArray(lines, *path) || lines.Num() < 2)
+		{
+			return false;
+		}
+
+		TArray<FString> header;
+		lines[0].ParseIntoArray(header, TEXT(","), false);
+		TArray<int> columnIndices;
+		for(auto& column : columns)
+		{
+			const int index = header.IndexOfByKey(column);
+			if(index == INDEX_NONE)
+			{
+				return false;
+			}
+			columnIndices.Add(index);
+		}
+
+		means.Init(0, columns.Num());
+		int sampleCount = 0;
+		for(int i = 1; i<lines.Num(); ++i)
+		{
+			TArray<FString> cells;
+			if(lines[i].ParseIntoArray(cells, TEXT(","), false) != header.Num())
+			{
+				continue;
+			}
+			for(int c = 0; c<columnIndices.Num(); ++c)
+			{
+				means[c] += FCString::Atod(*cells[columnIndices[c]]);
+			}
+			++sampleCount;
+		}
+
+		if(sampleCount == 0)
+		{
+			return false;
+		}
+		for(auto& mean : means)
+		{
+			mean /= sampleCount;
+		}
+		return true;
+	}
+}
+
+void FDungeonBenchmarkTest::GetTests(TArray<FString>& OutBeautifiedNames, TArray<FString>& OutTestCommands) const
+{
+	// Case names become file names, the commands are the case name followed by ; separated property assignments
+	const TArray<TPair<FString, FString>> sizes = {
+		{TEXT("Size30"), TEXT("(X=30,Y=30,Z=5)")},
+		{TEXT("Size60"), TEXT("(X=60,Y=60,Z=5)")},
+		{TEXT("Size120"), TEXT("(X=120,Y=120,Z=5)")}};
+	const TArray<int> minRoomCounts = {4, 16};
+	const TArray<TPair<FString, FString>> loopProbabilities = {
+		{TEXT("Loop10"), TEXT("0.1")},
+		{TEXT("Loop50"), TEXT("0.5")}};
+	const TArray<bool> switches = {false, true};
+
+	for(auto& size : sizes)
+	{
+		for(int minRoomCount : minRoomCounts)
+		{
+			for(auto& loopProbability : loopProbabilities)
+			{
+				for(bool isFloorBased : switches)
+				{
+					for(bool isProcGen : switches)
+					{
+						const FString caseName = FString::Printf(TEXT("%s_Rooms%d_%s_Floors%d_ProcGen%d"),
+							*size.Key, minRoomCount, *loopProbability.Key, isFloorBased, isProcGen);
+						OutBeautifiedNames.Add(caseName);
+						OutTestCommands.Add(FString::Printf(TEXT("%s;DungeonSize=%s;MinRoomCount=%d;LoopProbability=%s;IsDungeonFloorBased=%s;IsRoomProcGen=%s"),
+							*caseName, *size.Value, minRoomCount, *loopProbability.Value,
+							isFloorBased ? TEXT("True") : TEXT("False"), isProcGen ? TEXT("True") : TEXT("False")));
+					}
+				}
+			}
+		}
+	}
+}
+
+bool FDungeonBenchmarkTest::RunTest(const FString& Parameters)
+{
+	using namespace DungeonBenchmark;
+
+	FString generatorPath;
+	ReadSetting(TEXT("Generator"), generatorPath);
+	if(generatorPath.IsEmpty())
+	{
+		AddWarning(TEXT("No generator class, set -DungeonBenchmarkGenerator=<Class path> or [DungeonBenchmark] Generator"));
+		return true;
+	}
+	UClass* generatorClass = LoadClass<ADungeonGenerator>(nullptr, *generatorPath);
+	if(!generatorClass)
+	{
+		AddError(FString::Printf(TEXT("%s is not a DungeonGenerator class"), *generatorPath));
+		return false;
+	}
+
+	FString seedSetting = TEXT("3");
+	FString roomCountSetting = TEXT("20");
+	FString thresholdSetting = TEXT("0.2");
+	FString baselineDir = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("DungeonBenchmark"), TEXT("Baseline"));
+	ReadSetting(TEXT("Seeds"), seedSetting);
+	ReadSetting(TEXT("RoomCount"), roomCountSetting);
+	ReadSetting(TEXT("Threshold"), thresholdSetting);
+	ReadSetting(TEXT("Baseline"), baselineDir);
+	const int seedCount = FMath::Max(FCString::Atoi(*seedSetting), 1);
+	const int roomCount = FCString::Atoi(*roomCountSetting);
+	const double threshold = FCString::Atod(*thresholdSetting);
+
+	TArray<FString> overrides;
+	Parameters.ParseIntoArray(overrides, TEXT(";"));
+	const FString caseName = overrides.IsEmpty() ? TEXT("Default") : overrides[0];
+	if(!overrides.IsEmpty())
+	{
+		overrides.RemoveAt(0);
+	}
+
+	TArray<FSample> samples;
+	for(int seed = 0; seed<seedCount; ++seed)
+	{
+		UWorld* world = UWorld::CreateWorld(EWorldType::Game, false, TEXT("DungeonBenchmark"));
+		FWorldContext& worldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+		worldContext.SetCurrentWorld(world);
+		// BeginPlay is skipped so a blueprint can't start its own generation
+		world->InitializeActorsForPlay(FURL());
+
+		bool isConfigValid = false;
+		ADungeonGenerator* generator = world->SpawnActor<ADungeonGenerator>(generatorClass);
+		if(generator)
+		{
+			isConfigValid = SetProperty(generator, TEXT("UseRandomSeed"), TEXT("False"))
+				&& SetProperty(generator, TEXT("Seed"), FString::FromInt(seed))
+				&& SetProperty(generator, TEXT("UseLayoutCache"), TEXT("False"))
+				&& SetProperty(generator, TEXT("GenerationMode"), TEXT("SYNCHRONOUS"));
+			for(auto& override : overrides)
+			{
+				FString name, value;
+				if(!override.Split(TEXT("="), &name, &value) || !SetProperty(generator, name, value))
+				{
+					AddError(FString::Printf(TEXT("Property assignment %s failed"), *override));
+					isConfigValid = false;
+				}
+			}
+		}
+
+		if(isConfigValid)
+		{
+			FSample& sample = samples.AddDefaulted_GetRef();
+			const int actorsBefore = CountActors(world);
+			const FPlatformMemoryStats memoryBefore = FPlatformMemory::GetStats();
+
+			const double start = FPlatformTime::Seconds();
+			generator->GenerateDungeon(FTransform::Identity, roomCount);
+			sample.TotalMs = (FPlatformTime::Seconds() - start)*1000.0;
+
+			const FPlatformMemoryStats memoryAfter = FPlatformMemory::GetStats();
+			sample.ProcessMemoryDeltaKB = (static_cast<int64>(memoryAfter.UsedPhysical) - static_cast<int64>(memoryBefore.UsedPhysical))/1024;
+			sample.ProcessPeakKB = memoryAfter.PeakUsedPhysical/1024;
+			sample.GenerationMemoryKB = generator->GetGenerationMemory()/1024;
+			sample.ActorCount = CountActors(world) - actorsBefore;
+			sample.RoomCount = generator->GetLayout().Rooms.Num();
+			for(double seconds : generator->GetStageSeconds())
+			{
+				sample.StageMs.Add(seconds*1000.0);
+			}
+		}
+		else if(!generator)
+		{
+			AddError(FString::Printf(TEXT("%s couldn't be spawned"), *generatorPath));
+		}
+
+		GEngine->DestroyWorldContext(world);
+		world->DestroyWorld(false);
+
+		if(!isConfigValid)
+		{
+			return false;
+		}
+	}
+
+	const UEnum* stageEnum = StaticEnum<EDungeonGenerationStage>();
+	TArray<FString> columns = {TEXT("Seed"), TEXT("TotalMs")};
+	for(int stage = 0; stage<samples[0].StageMs.Num(); ++stage)
+	{
+		columns.Add(stageEnum->GetNameStringByIndex(stage) + TEXT("Ms"));
+	}
+	columns.Append({TEXT("GenerationMemoryKB"), TEXT("ProcessMemoryDeltaKB"), TEXT("ProcessPeakKB"), TEXT("Actors"), TEXT("Rooms")});
+
+	FString csv = FString::Join(columns, TEXT(",")) + LINE_TERMINATOR;
+	for(int seed = 0; seed<samples.Num(); ++seed)
+	{
+		const FSample& sample = samples[seed];
+		csv += FString::Printf(TEXT("%d,%.3f"), seed, sample.TotalMs);
+		for(double stageMs : sample.StageMs)
+		{
+			csv += FString::Printf(TEXT(",%.3f"), stageMs);
+		}
+		csv += FString::Printf(TEXT(",%lld,%lld,%lld,%d,%d"), sample.GenerationMemoryKB, sample.ProcessMemoryDeltaKB,
+			sample.ProcessPeakKB, sample.ActorCount, sample.RoomCount) + LINE_TERMINATOR;
+	}
+
+	const FString fileName = caseName + TEXT(".csv");
+	const FString outputPath = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("DungeonBenchmark"), fileName);
+	if(!FFileHelper::SaveStringToFile(csv, *outputPath))
+	{
+		AddError(FString::Printf(TEXT("Failed to write %s"), *outputPath));
+		return false;
+	}
+
+	// Process memory depends on everything else that runs, only the generator's own numbers are compared
+	const TArray<FString> comparedColumns = {TEXT("TotalMs"), TEXT("GenerationMemoryKB"), TEXT("Actors")};
+	TArray<double> current, baseline;
+	if(!ReadMeans(FPaths::Combine(baselineDir, fileName), comparedColumns, baseline))
+	{
+		AddInfo(FString::Printf(TEXT("No baseline for %s in %s"), *caseName, *baselineDir));
+		return true;
+	}
+	ReadMeans(outputPath, comparedColumns, current);
+
+	for(int i = 0; i<comparedColumns.Num(); ++i)
+	{
+		if(baseline[i] > 0 && current[i] > baseline[i]*(1.0 + threshold))
+		{
+			AddError(FString::Printf(TEXT("%s regressed: %s %.3f against baseline %.3f"),
+				*caseName, *comparedColumns[i], current[i], baseline[i]));
+		}
+	}
+
+	return !HasAnyErrors();
+}
+
+#endif
@@ -0,0 +1,151 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DungeonCellReplication.h"
+#include "DungeonGenerator.h"
+
+/*
+ * @brief Get the cells covered by a chunk, chunks on the border of the grid are cut off
+ * @param const Grid3D<EStructureType>& grid
+ * @param const FIntVector& chunk
+ * @param int chunkSize Number of cells along each side of a chunk
+ * @param FIntVector& start First cell index
+ * @param FIntVector& end One past the last cell index
+ */
+static void GetChunkCellRange(const Grid3D<EStructureType>& grid, const FIntVector& chunk, int chunkSize, FIntVector& start, FIntVector& end)
+{
+	const FIntVector cellCount = grid.GetCellCount();
+	start = chunk * chunkSize;
+	end = FIntVector(
+		FMath::Min(start.X + chunkSize, cellCount.X),
+		FMath::Min(start.Y + chunkSize, cellCount.Y),
+		FMath::Min(start.Z + chunkSize, cellCount.Z)
+	);
+}
+
+/*
+ * @brief Run-length encode the cells of the chunk
+ * @param Grid3D<EStructureType>& grid
+ * @param int chunkSize Number of cells along each side of a chunk
+ */
+void FDungeonCellChunk::Encode(Grid3D<EStructureType>& grid, int chunkSize)
+{
+	FIntVector start, end;
+	GetChunkCellRange(grid, Chunk, chunkSize, start, end);
+	const int unit = grid.GetUnit();
+
+	EncodedCells.Reset();
+	uint8 runType = 0;
+	uint8 runLength = 0;
+	
+	for(int z = start.Z; z<end.Z; ++z)
+	{
+		for(int y = start.Y; y<end.Y; ++y)
+		{
+			for(int x = start.X; x<end.X; ++x)
+			{
+				const uint8 type = static_cast<uint8>(grid[FVector(x, y, z) * unit]);
+				if(runLength > 0 && (type != runType || runLength == MAX_uint8))
+				{
+					EncodedCells.Add(runLength);
+					EncodedCells.Add(runType);
+					runLength = 0;
+				}
+				
+				runType = type;
+				runLength++;
+			}
+		}
+	}
+
+	if(runLength > 0)
+	{
+		EncodedCells.Add(runLength);
+		EncodedCells.Add(runType);
+	}
+}
+
+/*
+ * @brief Write the encoded cells back into the grid
+ * @param Grid3D<EStructureType>& grid
+ * @param int chunkSize Number of cells along each side of a chunk
+ */
+void FDungeonCellChunk::Decode(Grid3D<EStructureType>& grid, int chunkSize) const
+{
+	FIntVector start, end;
+	GetChunkCellRange(grid, Chunk, chunkSize, start, end);
+	const int unit = grid.GetUnit();
+
+	int runIndex = 0;
+	int runLeft = EncodedCells.Num() > 1 ? EncodedCells[0] : 0;
+	
+	for(int z = start.Z; z<end.Z; ++z)
+	{
+		for(int y = start.Y; y<end.Y; ++y)
+		{
+			for(int x = start.X; x<end.X; ++x)
+			{
+				while(runLeft == 0)
+				{
+					runIndex += 2;
+					if(runIndex + 1 >= EncodedCells.Num())
+					{
+						UE_LOG(LogTemp, Error, TEXT("Cell chunk is shorter than the grid!"));
+						return;
+					}
+					runLeft = EncodedCells[runIndex];
+				}
+				
+				grid[FVector(x, y, z) * unit] = static_cast<EStructureType>(EncodedCells[runIndex + 1]);
+				runLeft--;
+			}
+		}
+	}
+}
+
+/*
+ * @brief Set the cells of the chunk to NONE
+ * @param Grid3D<EStructureType>& grid
+ * @param int chunkSize Number of cells along each side of a chunk
+ */
+void FDungeonCellChunk::Clear(Grid3D<EStructureType>& grid, int chunkSize) const
+{
+	FIntVector start, end;
+	GetChunkCellRange(grid, Chunk, chunkSize, start, end);
+	const int unit = grid.GetUnit();
+
+	for(int z = start.Z; z<end.Z; ++z)
+	{
+		for(int y = start.Y; y<end.Y; ++y)
+		{
+			for(int x = start.X; x<end.X; ++x)
+			{
+				grid[FVector(x, y, z) * unit] = EStructureType::NONE;
+			}
+		}
+	}
+}
+
+void FDungeonCellChunk::PreReplicatedRemove(const FDungeonCellChunkArray& InArraySerializer)
+{
+	if(InArraySerializer.Owner)
+	{
+		InArraySerializer.Owner->RemoveCellChunk(*this);
+	}
+}
+
+void FDungeonCellChunk::PostReplicatedAdd(const FDungeonCellChunkArray& InArraySerializer)
+{
+	if(InArraySerializer.Owner)
+	{
+		InArraySerializer.Owner->ApplyCellChunk(*this);
+	}
+}
+
+void FDungeonCellChunk::PostReplicatedChange(const FDungeonCellChunkArray& InArraySerializer)
+{
+	if(InArraySerializer.Owner)
+	{
+		InArraySerializer.Owner->ApplyCellChunk(*this);
+	}
+}
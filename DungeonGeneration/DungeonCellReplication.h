@@ -0,0 +1,68 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Net/Serialization/FastArraySerializer.h"
+#include "DungeonLayout.h"
+#include "DungeonCellReplication.generated.h"
+
+class ADungeonGenerator;
+struct FDungeonCellChunkArray;
+
+// All cells of one chunk of the grid, run-length encoded
+USTRUCT()
+struct FDungeonCellChunk : public FFastArraySerializerItem
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	FIntVector Chunk = FIntVector::ZeroValue;
+
+	// Generation of the layout the cells belong to, counted by the server so regenerating with the same seed is a new layout
+	UPROPERTY()
+	int32 Generation = 0;
+
+	// Pairs of run length and structure type
+	UPROPERTY()
+	TArray<uint8> EncodedCells;
+
+	void Encode(Grid3D<EStructureType>& grid, int chunkSize);
+	void Decode(Grid3D<EStructureType>& grid, int chunkSize) const;
+	void Clear(Grid3D<EStructureType>& grid, int chunkSize) const;
+
+	void PreReplicatedRemove(const FDungeonCellChunkArray& InArraySerializer);
+	void PostReplicatedAdd(const FDungeonCellChunkArray& InArraySerializer);
+	void PostReplicatedChange(const FDungeonCellChunkArray& InArraySerializer);
+};
+
+/**
+ * Replicated cells of the generated dungeon, a chunk is only sent again once its cells change
+ * In actor replication mode the array holds every chunk of the grid so late joiners receive the whole grid,
+ * in seed mode clients build the grid themselves and the array only holds the chunks changed after the generation
+ */
+USTRUCT()
+struct FDungeonCellChunkArray : public FFastArraySerializer
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TArray<FDungeonCellChunk> Chunks;
+
+	// Receives the replicated chunks, not replicated
+	ADungeonGenerator* Owner = nullptr;
+
+	bool NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParams)
+	{
+		return FFastArraySerializer::FastArrayDeltaSerialize<FDungeonCellChunk, FDungeonCellChunkArray>(Chunks, DeltaParams, *this);
+	}
+};
+
+template<>
+struct TStructOpsTypeTraits<FDungeonCellChunkArray> : public TStructOpsTypeTraitsBase2<FDungeonCellChunkArray>
+{
+	enum
+	{
+		WithNetDeltaSerializer = true,
+	};
+};
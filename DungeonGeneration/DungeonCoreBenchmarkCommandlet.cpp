@@ -0,0 +1,212 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DungeonCoreBenchmarkCommandlet.h"
+#include "Grid3D.h"
+#include "TPriorityQueue.h"
+#include "DungeonGraph.h"
+#include "DungeonPathfinder3D.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+UDungeonCoreBenchmarkCommandlet::UDungeonCoreBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+/*
+ * @brief Run the benchmarks matching the filter and write the results
+ * @param const FString& Params Command line of the commandlet
+ * @return int32 0 if the report was written
+ */
+int32 UDungeonCoreBenchmarkCommandlet::Main(const FString& Params)
+{
+	FParse::Value(*Params, TEXT("Size="), GridSize);
+	FParse::Value(*Params, TEXT("Points="), PointCount);
+	FParse::Value(*Params, TEXT("Iterations="), IterationCount);
+	FParse::Value(*Params, TEXT("Filter="), Filter);
+	GridSize = FMath::Max(GridSize, 4);
+	PointCount = FMath::Max(PointCount, 2);
+	IterationCount = FMath::Max(IterationCount, 1);
+
+	FString reportPath;
+	if(!FParse::Value(*Params, TEXT("Output="), reportPath))
+	{
+		reportPath = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("DungeonBatch"), TEXT("DungeonCoreBenchmark.csv"));
+	}
+
+	Report = TEXT("Benchmark,Operations,BestNsPerOp,MeanNsPerOp");
+	Report += LINE_TERMINATOR;
+
+	// Results are summed so the compiler can't drop the loops
+	int64 sink = 0;
+	const FRandomStream stream(0);
+
+	// ====== Grid access ======
+	Grid3D<int> grid(FVector(GridSize, GridSize, GridSize), 0.0f, 1);
+	const FIntVector cellCount = grid.GetCellCount();
+	const int64 cellTotal = static_cast<int64>(cellCount.X) * cellCount.Y * cellCount.Z;
+
+	RunBenchmark(TEXT("Grid_IndexXInner"), [&]()
+	{
+		for(int z = 0; z<cellCount.Z; ++z)
+			for(int y = 0; y<cellCount.Y; ++y)
+				for(int x = 0; x<cellCount.X; ++x)
+					sink += grid[FVector(x, y, z)];
+		return cellTotal;
+	});
+
+	RunBenchmark(TEXT("Grid_IndexZInner"), [&]()
+	{
+		for(int x = 0; x<cellCount.X; ++x)
+			for(int y = 0; y<cellCount.Y; ++y)
+				for(int z = 0; z<cellCount.Z; ++z)
+					sink += grid[FVector(x, y, z)];
+		return cellTotal;
+	});
+
+	RunBenchmark(TEXT("Grid_RowScan"), [&]()
+	{
+		for(int z = 0; z<cellCount.Z; ++z)
+			for(int y = 0; y<cellCount.Y; ++y)
+				for(const int cell : grid.GetRow(y, z))
+					sink += cell;
+		return cellTotal;
+	});
+
+	RunBenchmark(TEXT("Grid_Reset"), [&]()
+	{
+		grid.Reset(FVector(GridSize, GridSize, GridSize), 0.0f, 1);
+		return cellTotal;
+	});
+
+	// ====== Heap ======
+	const int nodeCount = GridSize * GridSize;
+	TArray<float> costs;
+	for(int i = 0; i<nodeCount; ++i)
+	{
+		costs.Add(stream.FRandRange(0.0f, 1000.0f));
+	}
+
+	RunBenchmark(TEXT("Heap_PushPop"), [&]()
+	{
+		TPriorityQueue<DungeonNode> queue;
+		DungeonNode node;
+		for(const float cost : costs)
+		{
+			node.Cost = cost;
+			queue.Push(node);
+		}
+		while(!queue.IsEmpty())
+		{
+			sink += FMath::TruncToInt(queue.Pop().Cost);
+		}
+		return static_cast<int64>(nodeCount) * 2;
+	});
+
+	// ====== Pathfinding ======
+	// One floor, the border cells are outside the search bounds
+	const FVector pathGridSize = FVector(GridSize, GridSize, 2);
+	const FVector pathStart = FVector(1, 1, 1);
+	const FVector pathEnd = FVector(GridSize - 1, GridSize - 1, 1);
+
+	Grid3D<bool> blocked(pathGridSize, 0.0f, 1);
+	for(int y = 0; y<GridSize; ++y)
+	{
+		for(int x = 0; x<GridSize; ++x)
+		{
+			blocked[FVector(x, y, 1)] = stream.FRand() < 0.3f;
+		}
+	}
+	blocked[pathStart] = false;
+	blocked[pathEnd] = false;
+
+	DungeonPathfinder3D pathfinder(pathGridSize, 1);
+	auto runFindPath = [&](bool hasObstacles)
+	{
+		pathfinder.ResetStats();
+		const TArray<FVector> path = pathfinder.FindPath(pathStart, pathEnd, [&](const DungeonNode& a, const DungeonNode& b)
+		{
+			DungeonPathInfo info;
+			info.Traversable = !hasObstacles || !blocked[b.Position];
+			info.Cost = FVector::Distance(b.Position, pathEnd);
+			return info;
+		}, false);
+
+		sink += path.Num();
+		return static_cast<int64>(pathfinder.GetStats().Expansions.Sum);
+	};
+
+	RunBenchmark(TEXT("FindPath_Open"), [&]() { return runFindPath(false); });
+	RunBenchmark(TEXT("FindPath_Obstacles"), [&]() { return runFindPath(true); });
+
+	// ====== Graph ======
+	TArray<FVector> points;
+	for(int i = 0; i<PointCount; ++i)
+	{
+		points.Add(FVector(stream.RandRange(0, GridSize), stream.RandRange(0, GridSize), stream.RandRange(0, 4)));
+	}
+	TArray<FDungeonEdge> edges;
+	for(int i = 0; i<points.Num(); ++i)
+	{
+		for(int j = i + 1; j<points.Num(); ++j)
+		{
+			edges.Add(FDungeonEdge(points[i], points[j]));
+		}
+	}
+
+	RunBenchmark(TEXT("MST_CompleteGraph"), [&]()
+	{
+		sink += DungeonGraph::MinimumSpanningTree(edges, points[0]).Num();
+		return static_cast<int64>(edges.Num());
+	});
+
+	RunBenchmark(TEXT("MST_AddRandomEdges"), [&]()
+	{
+		const TArray<FDungeonEdge> tree = DungeonGraph::MinimumSpanningTree(edges, points[0]);
+		sink += DungeonGraph::AddRandomEdges(FRandomStream(1), edges, tree, 0.125f).Num();
+		return static_cast<int64>(edges.Num());
+	});
+
+	UE_LOG(LogTemp, Display, TEXT("Benchmark checksum %lld"), sink);
+
+	if(!FFileHelper::SaveStringToFile(Report, *reportPath))
+	{
+		UE_LOG(LogTemp, Error, TEXT("Failed to write the benchmark report %s!"), *reportPath);
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * @brief Time a benchmark over the iterations
+ * @param const TCHAR* name Skipped if it doesn't contain the filter
+ * @param TFunctionRef<int64()> benchmark Returns the number of operations it did
+ */
+void UDungeonCoreBenchmarkCommandlet::RunBenchmark(const TCHAR* name, TFunctionRef<int64()> benchmark)
+{
+	if(!Filter.IsEmpty() && !FCString::Stristr(name, *Filter))
+		return;
+
+	double bestSeconds = MAX_dbl;
+	double totalSeconds = 0.0;
+	int64 operations = 1;
+	for(int i = 0; i<IterationCount; ++i)
+	{
+		const double startTime = FPlatformTime::Seconds();
+		operations = FMath::Max<int64>(benchmark(), 1);
+		const double seconds = FPlatformTime::Seconds() - startTime;
+
+		bestSeconds = FMath::Min(bestSeconds, seconds);
+		totalSeconds += seconds;
+	}
+
+	const double bestNs = bestSeconds * 1e9 / operations;
+	const double meanNs = totalSeconds * 1e9 / IterationCount / operations;
+	UE_LOG(LogTemp, Display, TEXT("%-24s %12lld ops  best %9.2f ns/op  mean %9.2f ns/op"), name, operations, bestNs, meanNs);
+
+	Report += FString::Printf(TEXT("%s,%lld,%.3f,%.3f"), name, operations, bestNs, meanNs);
+	Report += LINE_TERMINATOR;
+}
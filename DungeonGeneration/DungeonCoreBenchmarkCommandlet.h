@@ -0,0 +1,33 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "DungeonCoreBenchmarkCommandlet.generated.h"
+
+/**
+ * Microbenchmarks of the generation core, only the Core dependent classes run so no assets are loaded
+ *
+ * UnrealEditor-Cmd <Project> -run=DungeonCoreBenchmark -nullrhi -Size=64 -Points=200 -Iterations=5 -Filter=FindPath
+ */
+UCLASS()
+class NETWORKINGPROTOTYPE_API UDungeonCoreBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UDungeonCoreBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+private:
+	// Run a benchmark that returns its number of operations, the best and mean time per operation are logged
+	void RunBenchmark(const TCHAR* name, TFunctionRef<int64()> benchmark);
+
+	int GridSize = 64;
+	int PointCount = 200;
+	int IterationCount = 5;
+	FString Filter;
+	FString Report;
+};
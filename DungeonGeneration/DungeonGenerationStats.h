@@ -0,0 +1,22 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+
+// Shown with "stat DungeonGen", the stages are traced as CPU events for Unreal Insights
+DECLARE_STATS_GROUP(TEXT("DungeonGen"), STATGROUP_DungeonGen, STATCAT_Advanced);
+
+// Totals of the current generation, reset when a generation starts
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Rooms Placed"), STAT_DungeonGenRoomsPlaced, STATGROUP_DungeonGen, NETWORKINGPROTOTYPE_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Rooms Rejected"), STAT_DungeonGenRoomsRejected, STATGROUP_DungeonGen, NETWORKINGPROTOTYPE_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Edges Routed"), STAT_DungeonGenEdgesRouted, STATGROUP_DungeonGen, NETWORKINGPROTOTYPE_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Edges Failed"), STAT_DungeonGenEdgesFailed, STATGROUP_DungeonGen, NETWORKINGPROTOTYPE_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Nodes Expanded"), STAT_DungeonGenNodesExpanded, STATGROUP_DungeonGen, NETWORKINGPROTOTYPE_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Actors Spawned"), STAT_DungeonGenActorsSpawned, STATGROUP_DungeonGen, NETWORKINGPROTOTYPE_API);
+
+// Memory of the layout and the pathfinder, updated when the data stages are done
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Layout Memory"), STAT_DungeonGenLayoutMemory, STATGROUP_DungeonGen, NETWORKINGPROTOTYPE_API);
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Pathfinder Memory"), STAT_DungeonGenPathfinderMemory, STATGROUP_DungeonGen, NETWORKINGPROTOTYPE_API);
@@ -2,8 +2,25 @@
 
 
 #include "DungeonGenerator.h"
+#include "DungeonGenerationStats.h"
 
 #include "Net/UnrealNetwork.h"
+#include "GameFramework/PlayerController.h"
+#include "GameFramework/Pawn.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryWriter.h"
+#include "Async/ParallelFor.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/StaticMesh.h"
+
+DEFINE_STAT(STAT_DungeonGenRoomsPlaced);
+DEFINE_STAT(STAT_DungeonGenRoomsRejected);
+DEFINE_STAT(STAT_DungeonGenEdgesRouted);
+DEFINE_STAT(STAT_DungeonGenEdgesFailed);
+DEFINE_STAT(STAT_DungeonGenNodesExpanded);
+DEFINE_STAT(STAT_DungeonGenActorsSpawned);
+DEFINE_STAT(STAT_DungeonGenLayoutMemory);
+DEFINE_STAT(STAT_DungeonGenPathfinderMemory);
 
 // Sets default values
 ADungeonGenerator::ADungeonGenerator()
@@ -14,6 +31,12 @@ ADungeonGenerator::ADungeonGenerator()
 	bReplicates = true;
 	bAlwaysRelevant = true;
 	freeGenerationMode = false;
+
+	// Instanced meshes of the dungeon are attached to the root
+	RootComponent = CreateDefaultSubobject<USceneComponent>(TEXT("DungeonRoot"));
+
+	materializer = FDungeonMaterializer(this);
+	ReplicatedCells.Owner = this;
 }
 
 // Called when the game starts or when spawned
@@ -22,67 +45,70 @@ void ADungeonGenerator::BeginPlay()
 	Super::BeginPlay();
 }
 
+// Called when the actor is removed
+void ADungeonGenerator::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	// The background task uses this actor, it must not outlive it
+	StopBackgroundGeneration();
+	if(layoutCacheSaveTask.IsValid())
+	{
+		layoutCacheSaveTask.Wait();
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
 // Called every frame
 void ADungeonGenerator::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
-	
+
+	// Send the cells changed this frame
+	if(HasAuthority() && !dirtyCellChunks.IsEmpty())
+	{
+		FlushDirtyCellChunks();
+	}
+
+	// Wait for the data stages running in the background
+	if(!PollBackgroundGeneration())
+		return;
+
+	// Advance the time sliced generation within the frame budget
+	if(GenerationMode != EDungeonGenerationMode::SYNCHRONOUS && IsGenerating())
+	{
+		AdvanceGeneration(FrameBudgetMs);
+	}
 }
 
 void ADungeonGenerator::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
 {
 	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
 
+	DOREPLIFETIME(ADungeonGenerator, ReplicatedGenerationParams);
+	DOREPLIFETIME(ADungeonGenerator, ReplicatedCells);
 	DOREPLIFETIME(ADungeonGenerator, ReplicatedRoomLocations);
 	DOREPLIFETIME(ADungeonGenerator, IsGenerated);
 }
 
-/*
- * @brief Spawn a room at the transform location
- * @param FTransform transform of the room
- * @param TSubclassOf<AMainRoom> The class reference of the room to spawn
- * @return AMainRoom* The spawned room
- */
-AMainRoom* ADungeonGenerator::SpawnStructure(FTransform transform, TSubclassOf<AMainRoom> room, bool checkCollision = true)
+void ADungeonGenerator::PreReplication(IChangedPropertyTracker& ChangedPropertyTracker)
 {
-	if(checkCollision &&
-		IsLocationOccupied(
-			transform.GetLocation(),
-			transform.GetRotation(), 
-			FVector(1.0f, 1.0f, 1.0f)
-			))
-	{
-		return nullptr;
-	}
-	
-	if(IsValid(room->GetClass()))
-	{
-		return GetWorld()->SpawnActor<AMainRoom>(room, transform);
-	}
-	else
-	{
-		UE_LOG(LogTemp, Error, TEXT("Room class is invalid or null!"));
-		return nullptr;
-	}
+	Super::PreReplication(ChangedPropertyTracker);
+
+	// Clients get the room locations from their own layout
+	DOREPLIFETIME_ACTIVE_OVERRIDE(ADungeonGenerator, ReplicatedRoomLocations, ReplicationMode == EDungeonReplicationMode::ACTORS);
 }
 
 /*
- * @brief Spawn a door at the transform location
- * @param FTransform transform of the door
- * @param TSubclassOf<ABasicDoor> The class reference of the door to spawn
- * @return ABasicDoor* The spawned door
+ * @brief Rebuild the dungeon of the server from the replicated seed and parameters
  */
-ABasicDoor* ADungeonGenerator::SpawnDoor(FTransform transform, TSubclassOf<ABasicDoor> door)
+void ADungeonGenerator::OnRep_GenerationParams()
 {
-	if(IsValid(door->GetClass()))
-	{
-		return GetWorld()->SpawnActor<ABasicDoor>(door, transform);
-	}
-	else
-	{
-		UE_LOG(LogTemp, Error, TEXT("Door class is invalid or null!"));
-		return nullptr;
-	}
+	if(ReplicationMode != EDungeonReplicationMode::SEED)
+		return;
+
+	Seed = ReplicatedGenerationParams.Seed;
+	cellGeneration = ReplicatedGenerationParams.Generation;
+	StartGeneration(ReplicatedGenerationParams.StartingPoint, ReplicatedGenerationParams.RoomCount);
 }
 
 /*
@@ -92,42 +118,70 @@ ABasicDoor* ADungeonGenerator::SpawnDoor(FTransform transform, TSubclassOf<ABasi
  */
 void ADungeonGenerator::GenerateRooms(FTransform startingPoint, int roomSpawnSteps)
 {
-	// Generate the entrance room
-	AMainRoom* entranceSpawned = SpawnStructure(startingPoint, EntranceRoom, false);
+	if(!GenerateEntranceRoom(startingPoint))
+		return;
+	
+	// Generate the rest of the rooms
+	for(int i = 1; i<roomSpawnSteps; ++i)
+	{
+		GenerateNextRoom();
+	}
 	
-	if(!entranceSpawned)
+	// Sort the rooms by floor
+	layout.RoomTable.BuildFloorRanges();
+}
+
+/*
+ * @brief Generate the entrance room
+ * @param const FTransform& Starting point of the dungeon
+ * @return bool True if the rest of the rooms can be generated
+ */
+bool ADungeonGenerator::GenerateEntranceRoom(const FTransform& startingPoint)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(DungeonGen_PlaceEntrance);
+
+	if(!IsValid(EntranceRoom.Get()))
 	{
 		UE_LOG(LogTemp, Error, TEXT("Entrance Room is invalid or null!"));
-		return;
+		return false;
 	}
 
-	entranceSpawned->InitInfo(startingPoint, FVector::OneVector, entranceSpawned->Bounds);
-	spawnedRooms.Add(TArray<AMainRoom*>());
-	spawnedRooms[0].Add(entranceSpawned);
+	FDungeonRoomData entrance;
+	entrance.PrefabType = EDungeonPrefabType::ENTRANCE;
+	entrance.Transform = startingPoint;
+	entrance.Bounds = GetPrefabInfo(EntranceRoom).Bounds;
+	entrance.CheckCollision = false;
+	
+	layout.RoomGroups.Add(TArray<int>());
+	layout.AddRoom(entrance, 0, INDEX_NONE, GetPlacementBounds(entrance.Transform.GetLocation(), entrance.Scale));
 	currentRoomGroupIndex++;
+	INC_DWORD_STAT(STAT_DungeonGenRoomsPlaced);
 
 	// Check if we have room to spawn
 	if(RoomList.Num() <= 0)
 	{
 		UE_LOG(LogTemp, Error, TEXT("Room list is empty or null!"));
-		return;
+		return false;
 	}
-	
-	// Generate the rest of the rooms
-	for(int i = 1; i<roomSpawnSteps; ++i)
+
+	return true;
+}
+
+/*
+ * @brief Try to generate one more room group
+ */
+void ADungeonGenerator::GenerateNextRoom()
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(DungeonGen_PlaceRoom);
+
+	if(IsRoomProcGen)
 	{
-		if(IsRoomProcGen)
-		{
-			GenerateProcGenRooms();
-		}
-		else
-		{
-			GeneratePremadeRooms();
-		}
+		GenerateProcGenRooms();
+	}
+	else
+	{
+		GeneratePremadeRooms();
 	}
-	
-	// Sort the room map
-	floorRoomMap.KeySort([](int a, int b) { return a < b; });
 }
 
 /*
@@ -135,29 +189,26 @@ void ADungeonGenerator::GenerateRooms(FTransform startingPoint, int roomSpawnSte
  */
 void ADungeonGenerator::Triangulate()
 {
+	TRACE_CPUPROFILER_EVENT_SCOPE(DungeonGen_Triangulate);
+
 	if(IsDungeonFloorBased)
 	{
-		for(auto& floor : floorRoomMap)
+		const FDungeonRoomTable& rooms = layout.RoomTable;
+		for(const FDungeonFloorRange& floor : rooms.FloorRanges)
 		{
-			for(const auto& room : floor.Value)
+			TArray<FVector>& floorVertices = floorVertexMap.FindOrAdd(floor.Floor);
+			for(int i = floor.First; i<floor.First + floor.Count; ++i)
 			{
-				if(!floorVertexMap.Contains(floor.Key))
-				{
-					floorVertexMap.Add(floor.Key, TArray<FVector>());
-				}
-				FVector center = FVector(room->Bounds.GetCenter().X, room->Bounds.GetCenter().Y, room->Bounds.Min.Z);
-				floorVertexMap[floor.Key].Add(center);
+				floorVertices.Add(GetRoomAnchor(rooms.Bounds[rooms.FloorRooms[i]]));
 			}
 
 			// Add room positions as stair vertices for stairs generation
-			if(!floorStairVertexMap.Contains(floor.Key))
-			{
-				floorStairVertexMap.Add(floor.Key, TArray<FVector>());
-			}
+			TArray<FVector>& stairVertices = floorStairVertexMap.FindOrAdd(floor.Floor);
+			const FRandomStream floorStream = MakeRandomStream(EDungeonGenerationStage::TRIANGULATION, floor.Floor);
 			for(int i = 0; i<MaxStairCaseCount; ++i)
 			{
-				int roomIndex = FMath::RandRange(0, floor.Value.Num()-1);
-				floorStairVertexMap[floor.Key].Add(floorVertexMap[floor.Key][roomIndex]);
+				int roomIndex = floorStream.RandRange(0, floor.Count-1);
+				stairVertices.Add(floorVertices[roomIndex]);
 			}
 		}
 
@@ -184,11 +235,27 @@ void ADungeonGenerator::Triangulate()
 	}
 	else
 	{
-		for(const auto& roomGroup : spawnedRooms)
+		if(TriangulateRoomGroups)
+		{
+			// One vertex per group, hallways pick the rooms they attach to when they are queued
+			for(int groupIndex = 0; groupIndex < layout.RoomGroups.Num(); ++groupIndex)
+			{
+				if(layout.RoomGroups[groupIndex].IsEmpty())
+					continue;
+				
+				const FVector vertex = GetRoomGroupVertex(groupIndex);
+				roomVertices.Add(vertex);
+				vertexGroupMap.Add(vertex, groupIndex);
+			}
+		}
+		else
 		{
-			for(const auto& room : roomGroup)
+			for(const auto& roomGroup : layout.RoomGroups)
 			{
-				roomVertices.Add(room->Bounds.GetCenter());
+				for(const int roomIndex : roomGroup)
+				{
+					roomVertices.Add(layout.RoomTable.Bounds[roomIndex].GetCenter());
+				}
 			}
 		}
 
@@ -202,6 +269,8 @@ void ADungeonGenerator::Triangulate()
  */
 void ADungeonGenerator::FindPossibleHallways()
 {
+	TRACE_CPUPROFILER_EVENT_SCOPE(DungeonGen_FindPossibleHallways);
+
 	if(IsDungeonFloorBased)
 	{
 		FindPossibleHallwaysFloorBased();
@@ -217,15 +286,10 @@ void ADungeonGenerator::FindPossibleHallways()
  */
 void ADungeonGenerator::GenerateHallways()
 {
-	pathfinder = DungeonPathfinder3D(DungeonSize, DungeonUnit);
-	
-	if(IsDungeonFloorBased)
-	{
-		GenerateFloorBasedHallways();
-	}
-	else
+	BeginHallways();
+
+	while(RouteNextHallway(MAX_int32))
 	{
-		GenerateNormalHallways();
 	}
 }
 
@@ -234,63 +298,75 @@ void ADungeonGenerator::GenerateHallways()
  */
 void ADungeonGenerator::GenerateCourtyard()
 {
+	TRACE_CPUPROFILER_EVENT_SCOPE(DungeonGen_Courtyard);
+
 	if(!DebugMode && IsDungeonFloorBased && IsGroundFloorCourtyard)
 	{
 		FVector scale = FVector::OneVector;
-		const int index = FMath::RandRange(0, RoomList.Num()-1);
+		const int index = MakeRandomStream(EDungeonGenerationStage::COURTYARD).RandRange(0, RoomList.Num()-1);
 		const TSubclassOf<AMainRoom> newRoom = RoomList[index];
 		
-		FBox defaultBounds = newRoom->GetDefaultObject<AMainRoom>()->GetComponentsBoundingBox();
+		FBox defaultBounds = GetPrefabInfo(newRoom).ComponentsBounds;
 		FVector defaultOrigin, defaultExtent;
 		defaultOrigin = defaultBounds.GetCenter();
 		defaultExtent = DefaultRoomSize * 0.5f;
 		
 		int z = DungeonUnit*(GroundFloorIndex+1);
+		TArray<int> rows;
 		for(int y = DungeonUnit*2; y<DungeonSize.Y-DungeonUnit; y+=DungeonUnit)
+		{
+			rows.Add(y);
+		}
+
+		// Plan the free cells of each row in parallel, stamping only turns free cells into rooms so a cell taken before the pass stays taken
+		TArray<TArray<int>> rowCells;
+		rowCells.SetNum(rows.Num());
+		ParallelFor(rows.Num(), [&](int32 row)
 		{
 			for(int x = DungeonUnit*2; x<DungeonSize.X-DungeonUnit; x+=DungeonUnit)
 			{
-				FVector location = FVector(x, y, z);
+				if(layout.Grid[FVector(x, rows[row], z)] == EStructureType::NONE)
+				{
+					rowCells[row].Add(x);
+				}
+			}
+		});
+
+		// Rooms are stamped in scan order as a room can cover the cells after it
+		for(int row = 0; row<rows.Num(); ++row)
+		{
+			for(const int x : rowCells[row])
+			{
+				FVector location = FVector(x, rows[row], z);
+				if(layout.Grid[location] != EStructureType::NONE)
+					continue;
+
 				FVector newOrigin = location + defaultOrigin;
 				FVector newExtent = scale * defaultExtent + sizeGap;
 				FBox newBounds = FBox(newOrigin - newExtent, newOrigin + newExtent);
 
-				FTransform transform = FTransform(FRotator::ZeroRotator, location, FVector::OneVector);
-				AMainRoom* newRoomSpawned = nullptr;
-					
-				switch(grid[location])
+				FDungeonRoomData courtyardRoom;
+				courtyardRoom.PrefabType = EDungeonPrefabType::ROOM;
+				courtyardRoom.PrefabIndex = index;
+				courtyardRoom.Transform = FTransform(FRotator::ZeroRotator, location, FVector::OneVector);
+				courtyardRoom.Scale = scale;
+				courtyardRoom.Bounds = newBounds;
+				const int roomIndex = layout.AddRoom(courtyardRoom, GroundFloorIndex, static_cast<int>(location.Z), GetPlacementBounds(location, scale));
+
+				// Set the structure type of the room in the grid
+				if(DefaultRoomSize.X > 1 && DefaultRoomSize.Y > 1 && DefaultRoomSize.Z > 1)
 				{
-				case EStructureType::NONE:
-					newRoomSpawned = SpawnStructure(transform, newRoom);
-					if(newRoomSpawned)
+					TArray<FVector> posInRoom = GetAllIntegerPointsInBox(newBounds);
+					for(auto& pos : posInRoom)
 					{
-						newRoomSpawned->InitInfo(transform, scale, newBounds);
-						spawnedRooms[GroundFloorIndex].Add(newRoomSpawned);
-
-						if(!floorRoomMap.Contains(location.Z))
-						{
-							floorRoomMap.Add(location.Z, TArray<AMainRoom*>());
-						}
-						floorRoomMap[location.Z].Add(newRoomSpawned);
-
-						// Set the structure type of the room in the grid
-						if(DefaultRoomSize.X > 1 && DefaultRoomSize.Y > 1 && DefaultRoomSize.Z > 1)
-						{
-							TArray<FVector> posInRoom = GetAllIntegerPointsInBox(newRoomSpawned->Bounds);
-							for(auto& pos : posInRoom)
-							{
-								grid[pos] = EStructureType::ROOM;
-							}
-						}
-						else
-						{
-							grid[location] = EStructureType::ROOM;
-						}
+						layout.Grid[pos] = EStructureType::ROOM;
 					}
-					break;
-				default:
-					break;
 				}
+				else
+				{
+					layout.Grid[location] = EStructureType::ROOM;
+				}
+				layout.SetRoomAnchor(GetRoomAnchor(courtyardRoom.Bounds), roomIndex);
 			}
 		}
 	}
@@ -301,13 +377,15 @@ void ADungeonGenerator::GenerateCourtyard()
  */
 void ADungeonGenerator::GenerateCeilings()
 {
+	TRACE_CPUPROFILER_EVENT_SCOPE(DungeonGen_Ceilings);
+
 	if(!DebugMode && IsDungeonFloorBased && ShouldGenerateBuilding)
 	{
 		FVector scale = FVector::OneVector;
-		const int index = FMath::RandRange(0, RoomList.Num()-1);
+		const int index = MakeRandomStream(EDungeonGenerationStage::CEILINGS).RandRange(0, RoomList.Num()-1);
 		const TSubclassOf<AMainRoom> newRoom = RoomList[index];
 		
-		FBox defaultBounds = newRoom->GetDefaultObject<AMainRoom>()->GetComponentsBoundingBox();
+		FBox defaultBounds = GetPrefabInfo(newRoom).ComponentsBounds;
 		FVector defaultOrigin, defaultExtent;
 		defaultOrigin = defaultBounds.GetCenter();
 		defaultExtent = DefaultRoomSize * 0.5f;
@@ -316,37 +394,39 @@ void ADungeonGenerator::GenerateCeilings()
 		if(startFloor >= DungeonSize.Z)
 			startFloor = DungeonSize.Z - DungeonUnit;
 		
+		TArray<int> slabs;
 		for(int z = startFloor; z<NormalFloorSize.Z; z+=DungeonUnit)
 		{
+			slabs.Add(z);
+		}
+
+		// Every slab only reads the grid, the plans are appended in slab order so the ceilings keep the scan order
+		TArray<FDungeonPiecePlan> plans;
+		plans.SetNum(slabs.Num());
+		ParallelFor(slabs.Num(), [&](int32 slab)
+		{
+			const int z = slabs[slab];
 			for(int y = DungeonUnit*2; y<NormalFloorSize.Y; y+=DungeonUnit)
 			{
 				for(int x = DungeonUnit*2; x<NormalFloorSize.X; x+=DungeonUnit)
 				{
 					FVector location = FVector(x, y, z);
+					if(!layout.Grid.InBoundsIgnoreOffset(location) || layout.Grid[location] != EStructureType::NONE)
+						continue;
+
 					FVector newOrigin = location + defaultOrigin;
 					FVector newExtent = scale * defaultExtent + sizeGap;
 					FBox newBounds = FBox(newOrigin - newExtent, newOrigin + newExtent);
 
 					FTransform transform = FTransform(FRotator::ZeroRotator, location, FVector::OneVector);
-					AMainRoom* newRoomSpawned = nullptr;
-
-					if(!grid.InBoundsIgnoreOffset(location))
-						continue;
-					
-					switch(grid[location])
-					{
-					case EStructureType::NONE:
-						newRoomSpawned = SpawnStructure(transform, newRoom, false);
-						if(newRoomSpawned)
-						{
-							newRoomSpawned->InitInfo(transform, scale, newBounds);
-						}
-						break;
-					default:
-						break;
-					}
+					plans[slab].Ceilings.Add(FDungeonPiece(EDungeonPrefabType::ROOM, index, transform, newBounds));
 				}
-			}	
+			}
+		});
+
+		for(const FDungeonPiecePlan& plan : plans)
+		{
+			layout.Ceilings.Append(plan.Ceilings);
 		}
 	}
 }
@@ -356,192 +436,228 @@ void ADungeonGenerator::GenerateCeilings()
  */
 void ADungeonGenerator::GenerateWalls()
 {
+	TRACE_CPUPROFILER_EVENT_SCOPE(DungeonGen_Walls);
+
 	if(WallList.Num() < 0)
 	{
 		UE_LOG(LogTemp, Error, TEXT("Wall list is empty or null!"));
 		return;
 	}
 
-	// Spawn walls for each room
-	for (auto& roomGroup : spawnedRooms)
+	// Every face of a cell points along one of the 2D directions, the offsets and rotations are shared by all cells
+	constexpr int faceCount = UE_ARRAY_COUNT(Directions2D);
+	FVector faceOffsets[faceCount];
+	FRotator faceRotations[faceCount];
+	for(int face = 0; face < faceCount; ++face)
 	{
+		faceOffsets[face] = Directions2D[face] * DungeonUnit;
+		const FVector wallDirection = faceOffsets[face].GetSafeNormal2D();
+		faceRotations[face] = FRotator(0, FMath::Atan2(wallDirection.Y, wallDirection.X) * (180.0f / PI), 0);
+	}
+
+	// Plan the walls of each room group in parallel, every group has its own stream and door budget and only reads the grid
+	// Rooms are visited in group order as the door budget of a group depends on which faces come first
+	TArray<FDungeonPiecePlan> groupPlans;
+	groupPlans.SetNum(layout.RoomGroups.Num());
+	ParallelFor(layout.RoomGroups.Num(), [&](int32 groupIndex)
+	{
+		FDungeonPiecePlan& plan = groupPlans[groupIndex];
+		const TArray<int>& roomGroup = layout.RoomGroups[groupIndex];
+		const FRandomStream groupStream = MakeRandomStream(EDungeonGenerationStage::WALLS, groupIndex);
 		int doorCounter = 0;
-		int randomDoorLimit = FMath::RandRange(1, MaxDoorCount);
+		int randomDoorLimit = groupStream.RandRange(1, MaxDoorCount);
 
-		for (auto& room : roomGroup)
+		for (const int roomIndex : roomGroup)
 		{
-			FVector pos = FVector(room->Bounds.GetCenter().X, room->Bounds.GetCenter().Y, room->Bounds.Min.Z);
-			TArray<FVector> nbs = pathfinder.GetNebighors2D(pos);
-			TArray<FVector> doorPoints = room->GetDoorPoints();
+			const FBox& roomBounds = layout.RoomTable.Bounds[roomIndex];
+			const FVector pos = FVector(roomBounds.GetCenter().X, roomBounds.GetCenter().Y, roomBounds.Min.Z);
+			const uint8 faceMask = GetNeighborMask2D(pos);
 
-			for (auto& nb : nbs)
+			// Walls should be at least 1 unit high but 1 unit less than the bounds height
+			int height = roomBounds.GetSize().Z / DungeonUnit;
+			if (height > 1)
 			{
-				FVector wallDirection = nb - pos;
-				wallDirection = wallDirection.GetSafeNormal2D();
-				float yawRotation = FMath::Atan2(wallDirection.Y, wallDirection.X) * (180.0f / PI);
-
-				FRotator wallRot = FRotator(0, yawRotation, 0);
-
-				// Spawn walls but don't block the stairs and room itself
-				FVector wallPos = pos + (nb - pos) * 0.5f;
-				int height = room->Bounds.GetSize().Z / DungeonUnit;
+				height--;
+			}
 
-				//if(IsRoomProcGen)
-				//{
-					// Walls should be at least 1 unit high bur 1 unit less than the bounds height
-					if (height > 1)
+			// Mark the faces holding a door once instead of searching the door points for every face
+			uint8 doorMask = 0;
+			for (const FVector& doorPoint : layout.Rooms[roomIndex].DoorPoints)
+			{
+				for (int face = 0; face < faceCount; ++face)
+				{
+					if (doorPoint == pos + faceOffsets[face] * 0.5f)
 					{
-						height--;
+						doorMask |= 1 << face;
 					}
+				}
+			}
 
-					// Check if door count maxed out
-					if (doorPoints.Contains(wallPos))
-					{
-						// Check if a door must be spawned
-						bool mustSpawnDoor = false;
-						if (grid[nb] == EStructureType::STAIRS) // If the wall is next to stairs
-						{
-							mustSpawnDoor = true;
-						}
+			for (int face = 0; face < faceCount; ++face)
+			{
+				if (!(faceMask & (1 << face)))
+					continue;
 
-						TArray<FVector> nbs2 = pathfinder.GetNebighors2D(nb);
-						// If the wall's neighbor is next to stairs
-						for (auto& nb2 : nbs2)
-						{
-							if (grid[nb2] == EStructureType::STAIRS)
-							{
-								mustSpawnDoor = true;
-								break;
-							}
-						}
+				const FVector nb = pos + faceOffsets[face];
+				const FVector wallPos = pos + faceOffsets[face] * 0.5f;
+				const FRotator& wallRot = faceRotations[face];
+				const EStructureType nbType = layout.Grid[nb];
 
-						// If so spawn a wall instead of a door
-						if (doorCounter >= randomDoorLimit && !mustSpawnDoor)
-						{
-							if (grid[nb] != EStructureType::ROOM)
-							{
-								for (int i = 0; i < height; ++i)
-								{
-									FVector finalWallPos = wallPos + FVector(0, 0, i * DungeonUnit);
-									FTransform transform = FTransform(wallRot, finalWallPos, FVector::OneVector);
-									SpawnStructure(transform, WallList[0], false);
-								}
-							}
-						}
-						else if(!DoorList.IsEmpty())
-						{
-							if(!spawnedDoors.Contains(wallPos))
-							{
-								FTransform transform = FTransform(wallRot, wallPos, FVector::OneVector);
-								ABasicDoor* spawnedDoor = SpawnDoor(transform, DoorList[0]);
-								spawnedDoors.Add(wallPos, spawnedDoor);
-							}
-						}
+				if (doorMask & (1 << face))
+				{
+					// A door next to stairs can't be replaced by a wall
+					const bool mustSpawnDoor = nbType == EStructureType::STAIRS || IsNextToStairs(nb);
 
-						// Spawn walls above the door if needed
-						if (height > 1)
+					// If the door count maxed out spawn a wall instead of a door
+					if (doorCounter >= randomDoorLimit && !mustSpawnDoor)
+					{
+						if (nbType != EStructureType::ROOM)
 						{
-							if (grid[nb] != EStructureType::ROOM)
+							for (int i = 0; i < height; ++i)
 							{
-								for (int i = 1; i < height; ++i)
-								{
-									FVector finalWallPos = wallPos + FVector(0, 0, i * DungeonUnit);
-									FTransform transform = FTransform(wallRot, finalWallPos, FVector::OneVector);
-									SpawnStructure(transform, WallList[0], false);
-								}
+								FVector finalWallPos = wallPos + FVector(0, 0, i * DungeonUnit);
+								plan.Walls.Add(FDungeonPiece(EDungeonPrefabType::WALL, 0, FTransform(wallRot, finalWallPos, FVector::OneVector)));
 							}
 						}
-
-						doorCounter++;
+					}
+					else if(!DoorList.IsEmpty())
+					{
+						plan.Doors.Add(FDungeonPiece(EDungeonPrefabType::DOOR, 0, FTransform(wallRot, wallPos, FVector::OneVector)));
 					}
 
-					// Spawn walls
-					if (!doorPoints.Contains(wallPos) && grid[nb] != EStructureType::ROOM && grid[nb] != EStructureType::STOP)
+					// Spawn walls above the door if needed
+					if (height > 1 && nbType != EStructureType::ROOM)
 					{
-						// Spawn walls based on the height of the room
-						for (int i = 0; i < height; ++i)
+						for (int i = 1; i < height; ++i)
 						{
 							FVector finalWallPos = wallPos + FVector(0, 0, i * DungeonUnit);
-							FTransform transform = FTransform(wallRot, finalWallPos, FVector::OneVector);
-							SpawnStructure(transform, WallList[0], false);
+							plan.Walls.Add(FDungeonPiece(EDungeonPrefabType::WALL, 0, FTransform(wallRot, finalWallPos, FVector::OneVector)));
 						}
 					}
-				//}
+
+					doorCounter++;
+				}
+				else if (nbType != EStructureType::ROOM && nbType != EStructureType::STOP)
+				{
+					// Spawn walls based on the height of the room
+					for (int i = 0; i < height; ++i)
+					{
+						FVector finalWallPos = wallPos + FVector(0, 0, i * DungeonUnit);
+						plan.Walls.Add(FDungeonPiece(EDungeonPrefabType::WALL, 0, FTransform(wallRot, finalWallPos, FVector::OneVector)));
+					}
+				}
 			}
 		}
-	}
+	});
 
-	// Spawn walls for each hallway
-	for(auto& pos : hallwaysVertices)
+	// Split the hallway cells in chunks planned in parallel, the cells are unique so every face is visited once
+	constexpr int hallwayChunkSize = 512;
+	TArray<FDungeonPiecePlan> hallwayPlans;
+	hallwayPlans.SetNum(FMath::DivideAndRoundUp(layout.HallwayCells.Num(), hallwayChunkSize));
+	ParallelFor(hallwayPlans.Num(), [&](int32 chunk)
 	{
-		TArray<FVector> nbs = pathfinder.GetNebighors2D(pos);
-
-		for(auto& nb : nbs)
+		const int last = FMath::Min((chunk + 1) * hallwayChunkSize, layout.HallwayCells.Num());
+		for(int cell = chunk * hallwayChunkSize; cell < last; ++cell)
 		{
-			FVector wallDirection = nb - pos;
-			wallDirection = wallDirection.GetSafeNormal2D();
-			float yawRotation = FMath::Atan2(wallDirection.Y, wallDirection.X) * (180.0f / PI);
-
-			FVector wallPos = pos + (nb - pos) * 0.5f;
-			FRotator wallRot = FRotator(0, yawRotation, 0);
-			
-			if(grid[nb] == EStructureType::NONE || grid[nb] == EStructureType::STOP)
+			const FVector& pos = layout.HallwayCells[cell];
+			const uint8 faceMask = GetNeighborMask2D(pos);
+			for(int face = 0; face < faceCount; ++face)
 			{
-				FTransform transform = FTransform(wallRot, wallPos, FVector::OneVector);
-				SpawnStructure(transform, WallList[0], false);
+				if(!(faceMask & (1 << face)))
+					continue;
+
+				const EStructureType nbType = layout.Grid[pos + faceOffsets[face]];
+				if(nbType == EStructureType::NONE || nbType == EStructureType::STOP)
+				{
+					FTransform transform = FTransform(faceRotations[face], pos + faceOffsets[face] * 0.5f, FVector::OneVector);
+					hallwayPlans[chunk].Walls.Add(FDungeonPiece(EDungeonPrefabType::WALL, 0, transform));
+				}
 			}
 		}
+	});
+
+	// Append the plans in order so the pieces don't depend on the scheduling
+	for(const FDungeonPiecePlan& plan : groupPlans)
+	{
+		layout.Walls.Append(plan.Walls);
+		for(const FDungeonPiece& door : plan.Doors)
+		{
+			layout.AddDoor(door.Transform.GetLocation(), door.Transform);
+		}
+	}
+	for(const FDungeonPiecePlan& plan : hallwayPlans)
+	{
+		layout.Walls.Append(plan.Walls);
 	}
 
 	// Spawn outer walls
 	if (IsDungeonFloorBased && ShouldGenerateBuilding)
 	{
-		for (int z = 0; z < DungeonSize.Z; z += DungeonUnit)
+		const int z = DungeonUnit * (GroundFloorIndex + 1);
+		if (z < 0 || z >= DungeonSize.Z)
+			return;
+
+		auto isShellCell = [this](int x, int y)
 		{
-			for (int y = 0; y < DungeonSize.Y; y += DungeonUnit)
+			return (x == DungeonUnit * 2 && y <= NormalFloorSize.Y)
+				|| (y == DungeonUnit * 2 && x <= NormalFloorSize.X)
+				|| (x == NormalFloorSize.X && y <= NormalFloorSize.Y)
+				|| (y == NormalFloorSize.Y && x <= NormalFloorSize.X);
+		};
+
+		// Exclude basement
+		const int outerWallHeight = (DungeonSize.Z - DungeonUnit * 2) / DungeonUnit;
+		auto addShellWalls = [&](const FVector& pos)
+		{
+			const uint8 faceMask = GetNeighborMask2D(pos);
+			for (int face = 0; face < faceCount; ++face)
+			{
+				if (!(faceMask & (1 << face)))
+					continue;
+
+				const FVector nb = pos + faceOffsets[face];
+				const FVector wallPos = pos + faceOffsets[face] * 0.5f;
+				const FRotator& wallRot = faceRotations[face];
+
+				if(layout.Grid[nb] == EStructureType::NONE)
+					layout.Walls.Add(FDungeonPiece(EDungeonPrefabType::WALL, 0, FTransform(wallRot, wallPos, FVector::OneVector)));
+
+				// Spawn walls based on the height of the room
+				for (int i = 0; i < outerWallHeight; ++i)
+				{
+					FVector nbHeight = FVector(nb.X, nb.Y, nb.Z + i * DungeonUnit);
+					if(layout.Grid[nbHeight] != EStructureType::NONE)
+						continue;
+
+					FVector finalWallPos = wallPos + FVector(0, 0, i * DungeonUnit);
+					layout.Walls.Add(FDungeonPiece(EDungeonPrefabType::WALL, 0, FTransform(wallRot, finalWallPos, FVector::OneVector)));
+				}
+			}
+		};
+
+		// Only the edge rows of the ground floor are scanned, the other rows hold at most the two side columns
+		const int sideColumns[2] = { FMath::Min<int>(DungeonUnit * 2, NormalFloorSize.X), FMath::Max<int>(DungeonUnit * 2, NormalFloorSize.X) };
+		for (int y = 0; y < DungeonSize.Y; y += DungeonUnit)
+		{
+			if (y == DungeonUnit * 2 || y == NormalFloorSize.Y)
 			{
 				for (int x = 0; x < DungeonSize.X; x += DungeonUnit)
 				{
-					FVector pos = FVector(x, y, z);
-					if (pos.Z == DungeonUnit * (GroundFloorIndex + 1))
-					{
-						if ((pos.X == DungeonUnit * 2 && pos.Y <= NormalFloorSize.Y)
-							|| (pos.Y == DungeonUnit * 2 && pos.X <= NormalFloorSize.X)
-							|| (pos.X == NormalFloorSize.X && pos.Y <= NormalFloorSize.Y)
-							|| (pos.Y == NormalFloorSize.Y && pos.X <= NormalFloorSize.X))
-						{
-							TArray<FVector> nbs = pathfinder.GetNebighors2D(pos);
-							for (auto& nb : nbs)
-							{
-								FVector wallDirection = nb - pos;
-								wallDirection = wallDirection.GetSafeNormal2D();
-								float yawRotation = FMath::Atan2(wallDirection.Y, wallDirection.X) * (180.0f / PI);
-
-								FVector wallPos = pos + (nb - pos) * 0.5f;
-								FRotator wallRot = FRotator(0, yawRotation, 0);
-								
-								FTransform transform = FTransform(wallRot, wallPos, FVector::OneVector);
-
-								if(grid[nb] == EStructureType::NONE)
-									SpawnStructure(transform, WallList[0], false);
-
-								// Spawn walls based on the height of the room
-								int outerWallHeight = (DungeonSize.Z - DungeonUnit * 2) / DungeonUnit;
-								// Exclude basement
-								for (int i = 0; i < outerWallHeight; ++i)
-								{
-									FVector nbHeight = FVector(nb.X, nb.Y, nb.Z + i * DungeonUnit);
-									if(grid[nbHeight] != EStructureType::NONE)
-										continue;
-									
-									FVector finalWallPos = wallPos + FVector(0, 0, i * DungeonUnit);
-									FTransform transform2 = FTransform(wallRot, finalWallPos, FVector::OneVector);
-									SpawnStructure(transform2, WallList[0], false);
-								}
-							}
-						}
-					}
+					if (isShellCell(x, y))
+						addShellWalls(FVector(x, y, z));
 				}
+				continue;
+			}
+
+			for (int column = 0; column < 2; ++column)
+			{
+				const int x = sideColumns[column];
+				if (column > 0 && x == sideColumns[0])
+					break;
+				if (x < 0 || x >= DungeonSize.X || x % DungeonUnit != 0)
+					continue;
+				if (isShellCell(x, y))
+					addShellWalls(FVector(x, y, z));
 			}
 		}
 	}
@@ -554,96 +670,184 @@ void ADungeonGenerator::GenerateWalls()
  */
 void ADungeonGenerator::GenerateDungeon(FTransform startingPoint, int roomCount)
 {
-	// Reset variables
-	grid = Grid3D<EStructureType>(DungeonSize, DungeonUnit, DungeonUnit);
-	
-	spawnedRooms.Empty();
-	
-	selectedEdges.Empty();
-	roomVertices.Empty();
-	hallwaysVertices.Empty();
-
-	floorRoomCount.Empty();
-	currentFloorIndex = 0;
-	for(int i = 0; i<=currentFloorIndex; ++i)
+	// Clients follow the seed of the server
+	if(ReplicationMode == EDungeonReplicationMode::SEED && !HasAuthority())
 	{
-		floorRoomCount.Add(0);
+		UE_LOG(LogTemp, Warning, TEXT("Clients build the dungeon from the replicated seed!"));
+		return;
 	}
 
-	// Generate the rooms
-	GenerateRooms(startingPoint, roomCount);
-
-	// Triangulate the rooms
-	Triangulate();
-
-	// Find all possible connections between rooms
-	FindPossibleHallways();
-
-	// Generate the optimal path between rooms
-	GenerateHallways();
-
-	// Clean up the dungeon
-	CleanUpDungeon();
-
-	// Generate courtyard if needed
-	GenerateCourtyard();
-
-	// Generate the ceilings
-	GenerateCeilings();
-
-	// Generate walls
-	GenerateWalls();
-
-	// Set the dungeon as generated
-	IsGenerated = true;
-
-	// DEBUG
-	// loop through the grid and print the structure type
-	if(DebugMode)
+	if(UseRandomSeed)
 	{
-		for(int z = 0; z<DungeonSize.Z; z+=DungeonUnit)
-		{
-			for(int y = 0; y<DungeonSize.Y; y+=DungeonUnit)
-			{
-				for(int x = 0; x<DungeonSize.X; x+=DungeonUnit)
-				{
-					FVector pos = FVector(x, y, z);
-					switch(grid[pos])
-					{
-					case EStructureType::STOP:
-						DrawDebugSphere(GetWorld(), pos, 0.25*DungeonUnit, 8, FColor::White, true, -1);
-							break;
-					case EStructureType::ROOM:
-						if(DebugType == EDungenDebugType::ROOM|| DebugType == EDungenDebugType::ALL)
-							DrawDebugSphere(GetWorld(), pos, 0.25*DungeonUnit, 8, FColor::Blue, true, -1);
-						break;
-					case EStructureType::HALLWAY:
-						if(DebugType == EDungenDebugType::HALLWAY|| DebugType == EDungenDebugType::ALL)
-							DrawDebugSphere(GetWorld(), pos, 0.25*DungeonUnit, 8, FColor::Green, true, -1);
-						break;
-					case EStructureType::STAIRS:
-						if(DebugType == EDungenDebugType::STAIRS|| DebugType == EDungenDebugType::ALL)
-							DrawDebugSphere(GetWorld(), pos, 0.25*DungeonUnit, 8, FColor::Cyan, true, -1);
-						break;
-					default:
-						break;
-					}
-				}
-			}
-		}
+		Seed = FMath::Rand();
 	}
+	
+	StartGeneration(startingPoint, roomCount);
 }
 
 /*
- * @brief Get a random room location
- * @return FVector Random room location
+ * @brief Start generating the dungeon with the current seed
+ * @param const FTransform& startingPoint Starting point of the dungeon
+ * @param int roomCount the number of rooms to spawn
  */
-FVector ADungeonGenerator::GetRandomRoomLocation()
+void ADungeonGenerator::StartGeneration(const FTransform& startingPoint, int roomCount)
 {
-	if(ReplicatedRoomLocations.Num() <= 0)
+	// A restart cancels the running generation, its listeners are told like with CancelGeneration
+	const bool wasGenerating = IsGenerating();
+	StopBackgroundGeneration();
+	if(wasGenerating)
 	{
-		UE_LOG(LogTemp, Error, TEXT("Room locations are empty or null!"));
-		return FVector::ZeroVector;
+		OnDungeonGenerated.Broadcast(false);
+	}
+	ResetGeneration(startingPoint, roomCount);
+
+	// A cached layout only needs to be materialized
+	if(UseLayoutCache)
+	{
+		isLayoutFromCache = FDungeonLayoutCache::Load(layout, layoutCacheKey);
+		if(isLayoutFromCache)
+		{
+			SetGenerationStage(EDungeonGenerationStage::MATERIALIZE);
+		}
+		else
+		{
+			layout.Reset(DungeonSize, DungeonUnit);
+		}
+	}
+
+	// Data stages run on a worker, the rest is advanced by Tick
+	if(GenerationMode == EDungeonGenerationMode::ASYNC)
+	{
+		LaunchBackgroundGeneration();
+		return;
+	}
+
+	// Time sliced generation is advanced by Tick
+	if(GenerationMode == EDungeonGenerationMode::TIME_SLICED)
+		return;
+
+	while(StepGeneration(MAX_int32))
+	{
+	}
+}
+
+/*
+ * @brief Change a cell of the generated dungeon, only the server can change cells
+ * @param const FVector& location
+ * @param EStructureType state
+ */
+void ADungeonGenerator::SetCellState(const FVector& location, EStructureType state)
+{
+	if(!HasAuthority() || currentStage != EDungeonGenerationStage::DONE)
+		return;
+	
+	if(!layout.Grid.InBoundsIgnoreOffset(location) || layout.Grid[location] == state)
+		return;
+
+	layout.Grid[location] = state;
+
+	const FVector index = layout.Grid.GetIndex(location);
+	dirtyCellChunks.Add(FIntVector(
+		FMath::FloorToInt(index.X / CellChunkSize),
+		FMath::FloorToInt(index.Y / CellChunkSize),
+		FMath::FloorToInt(index.Z / CellChunkSize)
+	));
+}
+
+/*
+ * @brief Get the state of a cell
+ * @param const FVector& location
+ * @return EStructureType
+ */
+EStructureType ADungeonGenerator::GetCellState(const FVector& location) const
+{
+	if(!layout.Grid.InBoundsIgnoreOffset(location))
+		return EStructureType::NONE;
+
+	return layout.Grid[location];
+}
+
+/*
+ * @brief Write a replicated chunk into the grid if it belongs to the local dungeon
+ * In actor replication mode clients don't build a layout, their grid is made of the replicated chunks
+ * @param const FDungeonCellChunk& chunk
+ */
+void ADungeonGenerator::ApplyCellChunk(const FDungeonCellChunk& chunk)
+{
+	if(ReplicationMode == EDungeonReplicationMode::ACTORS && !HasAuthority())
+	{
+		// Chunks of a new dungeon start from an empty grid
+		if(!hasClientCells || cellGeneration != chunk.Generation)
+		{
+			layout.Grid.Reset(DungeonSize, DungeonUnit, DungeonUnit);
+			cellGeneration = chunk.Generation;
+			hasClientCells = true;
+		}
+	}
+	else if(currentStage != EDungeonGenerationStage::DONE || chunk.Generation != cellGeneration)
+	{
+		return;
+	}
+
+	chunk.Decode(layout.Grid, CellChunkSize);
+	OnCellsChanged.Broadcast(chunk.Chunk);
+}
+
+/*
+ * @brief Clear a chunk the server removed, the server only removes chunks when it regenerates
+ * Clients in seed mode rebuild their grid with the new layout so only the replicated grid is cleared
+ * @param const FDungeonCellChunk& chunk
+ */
+void ADungeonGenerator::RemoveCellChunk(const FDungeonCellChunk& chunk)
+{
+	if(ReplicationMode != EDungeonReplicationMode::ACTORS || HasAuthority())
+		return;
+
+	if(!hasClientCells || cellGeneration != chunk.Generation)
+		return;
+
+	chunk.Clear(layout.Grid, CellChunkSize);
+	OnCellsChanged.Broadcast(chunk.Chunk);
+}
+
+/*
+ * @brief Check if the dungeon is still being generated
+ * @return bool True if a generation is in progress
+ */
+bool ADungeonGenerator::IsGenerating() const
+{
+	return GenerationStage != EDungeonGenerationStage::IDLE && GenerationStage != EDungeonGenerationStage::DONE;
+}
+
+/*
+ * @brief Cancel the current generation
+ */
+void ADungeonGenerator::CancelGeneration()
+{
+	if(!IsGenerating())
+		return;
+
+	// Tick finishes the cancellation once the background task has stopped
+	if(generationTask.IsValid())
+	{
+		*generationCancelToken = true;
+		return;
+	}
+
+	SetGenerationStage(EDungeonGenerationStage::IDLE);
+	OnDungeonGenerated.Broadcast(false);
+}
+
+/*
+ * @brief Get a random room location
+ * @return FVector Random room location
+ */
+FVector ADungeonGenerator::GetRandomRoomLocation()
+{
+	if(ReplicatedRoomLocations.Num() <= 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Room locations are empty or null!"));
+		return FVector::ZeroVector;
 	}
 	
 	int randomIndex = FMath::RandRange(0, ReplicatedRoomLocations.Num()-1);
@@ -656,25 +860,24 @@ FVector ADungeonGenerator::GetRandomRoomLocation()
  */
 int ADungeonGenerator::GetCurrentFloorNumber(const FVector& location) const
 {
-	FVector pos = location.GridSnap(DungeonUnit);
-	float Zpos = pos.Z;
-	int floor = (Zpos-DungeonUnit*3)/DungeonUnit;
-	return floor;
+	// Structures compute the floor of their viewers the same way for the relevancy
+	return AMainRoom::GetFloorNumber(location, DungeonUnit);
 }
 
 // ============ Helper Functions ============
 
 /*
  * @brief Get random room properties
+ * @param const FRandomStream& stream
  * @param FVector& location of the room
  * @param FVector& scale of the room
  */
-void ADungeonGenerator::GetRandomRoomProperties(TArray<FVector>& locations, FVector& scale)
+void ADungeonGenerator::GetRandomRoomProperties(const FRandomStream& stream, TArray<FVector>& locations, FVector& scale)
 {
 	// For easier calculations, we only return integer values
-	int scaleX = FMath::RandRange(static_cast<int>(MinRoomScale.X), static_cast<int>(MaxRoomScale.X));
-	int scaleY = FMath::RandRange(static_cast<int>(MinRoomScale.Y), static_cast<int>(MaxRoomScale.Y));
-	int scaleZ = FMath::RandRange(static_cast<int>(MinRoomScale.Z), static_cast<int>(MaxRoomScale.Z));
+	int scaleX = stream.RandRange(static_cast<int>(MinRoomScale.X), static_cast<int>(MaxRoomScale.X));
+	int scaleY = stream.RandRange(static_cast<int>(MinRoomScale.Y), static_cast<int>(MaxRoomScale.Y));
+	int scaleZ = stream.RandRange(static_cast<int>(MinRoomScale.Z), static_cast<int>(MaxRoomScale.Z));
 	
 	// Get the center location of the room
 	FVector centerlocation;
@@ -682,17 +885,17 @@ void ADungeonGenerator::GetRandomRoomProperties(TArray<FVector>& locations, FVec
 	if(!freeGenerationMode)
 	{
 		centerlocation = FVector(
-			GetRandomNumberWithInterval(0, static_cast<int>(NormalFloorSize.X)),
-			GetRandomNumberWithInterval(0, static_cast<int>(NormalFloorSize.Y)),
+			GetRandomNumberWithInterval(stream, 0, static_cast<int>(NormalFloorSize.X)),
+			GetRandomNumberWithInterval(stream, 0, static_cast<int>(NormalFloorSize.Y)),
 			DungeonUnit*(currentFloorIndex+1)
 		);
 	}
 	else
 	{
 		centerlocation = FVector(
-			GetRandomNumberWithInterval(0, static_cast<int>(NormalFloorSize.X)),
-			GetRandomNumberWithInterval(0, static_cast<int>(NormalFloorSize.Y)),
-			GetRandomNumberWithInterval(0, static_cast<int>(NormalFloorSize.Z))
+			GetRandomNumberWithInterval(stream, 0, static_cast<int>(NormalFloorSize.X)),
+			GetRandomNumberWithInterval(stream, 0, static_cast<int>(NormalFloorSize.Y)),
+			GetRandomNumberWithInterval(stream, 0, static_cast<int>(NormalFloorSize.Z))
 		);
 	}
 
@@ -786,17 +989,32 @@ void ADungeonGenerator::GetRandomRoomProperties(TArray<FVector>& locations, FVec
 
 /*
  * @brief Get a random number within an interval
+ * @param const FRandomStream& stream
  * @param int min
  * @param int max
  * @return int Random number within the interval
  */
-int ADungeonGenerator::GetRandomNumberWithInterval(int min, int max) const
+int ADungeonGenerator::GetRandomNumberWithInterval(const FRandomStream& stream, int min, int max) const
 {
 	int32 range = (max - min) / DungeonUnit + 1;
-	int32 randomValue = FMath::RandRange(0, range - 1);
+	int32 randomValue = stream.RandRange(0, range - 1);
 	return min + randomValue * DungeonUnit;
 }
 
+/*
+ * @brief Derive the random stream of a stage from the seed
+ * Streams don't depend on each other, so the result is the same no matter in which order or on which thread stages run.
+ * @param EDungeonGenerationStage stage
+ * @param int salt e.g. the floor or room group
+ * @return FRandomStream
+ */
+FRandomStream ADungeonGenerator::MakeRandomStream(EDungeonGenerationStage stage, int salt) const
+{
+	uint32 streamSeed = HashCombine(GetTypeHash(Seed), GetTypeHash(static_cast<uint8>(stage)));
+	streamSeed = HashCombine(streamSeed, GetTypeHash(salt));
+	return FRandomStream(static_cast<int32>(streamSeed));
+}
+
 /*
  * @brief Check if two rooms intersect
  * @param const FBox& roomA
@@ -837,107 +1055,6 @@ TArray<FVector> ADungeonGenerator::GetAllIntegerPointsInBox(const FBox& Box)
 	return Points;
 }
 
-/*
- * @brief Kruskal’s Algorithm to find the minimum spanning tree(MST)
- * @param const TArray<FEdge>& edges
- * @param const FVector& startVertex
- * @return TArray<FEdge> The minimum spanning tree
- */
-TArray<FEdge> ADungeonGenerator::MinimumSpanningTree(const TArray<FEdge>& edges, const FVector& startVertex)
-{
-	TSet<FVector> openSet;
-	TSet<FVector> closedSet;
-	TArray<FEdge> results;
-
-	// Initialize openSet with all vertices in the edges
-	for (const FEdge& edge : edges)
-	{
-		openSet.Add(edge.Vertex[0]);
-		openSet.Add(edge.Vertex[1]);
-	}
-
-	// Add the start vertex to closedSet
-	closedSet.Add(startVertex);
-
-	while (openSet.Num() > 0)
-	{
-		bool chosen = false;
-		FEdge chosenEdge;
-		float minWeight = std::numeric_limits<float>::infinity();
-
-		// Find the edge with the minimum weight that connects a closed vertex to an open vertex
-		for (const FEdge& edge : edges)
-		{
-			int closedVertices = 0;
-			if (!closedSet.Contains(edge.Vertex[0])) closedVertices++;
-			if (!closedSet.Contains(edge.Vertex[1])) closedVertices++;
-
-			if (closedVertices != 1) continue;
-
-			// Calculate the weight of the edge
-			float weight = FVector::Distance(edge.Vertex[0], edge.Vertex[1]);
-			if (weight < minWeight)
-			{
-				chosenEdge = edge;
-				chosen = true;
-				minWeight = weight;
-			}
-		}
-
-		// If no edge was chosen, break out of the loop
-		if (!chosen) break;
-
-		// Add the chosen edge to the results
-		results.Add(chosenEdge);
-		openSet.Remove(chosenEdge.Vertex[0]);
-		openSet.Remove(chosenEdge.Vertex[1]);
-		closedSet.Add(chosenEdge.Vertex[0]);
-		closedSet.Add(chosenEdge.Vertex[1]);
-	}
-
-	return results;
-}
-
-/*
- * @brief Add random edges to the MST to create a more complex dungeon
- * @param const TArray<FEdge>& originalEdges
- * @param TArray<FEdge>& mstEdges
- */
-TArray<FEdge> ADungeonGenerator::AddRandomEdgesToMST(const TArray<FEdge>& originalEdges, TArray<FEdge>& mstEdges,
-	float additionalEdgeProbability)
-{
-	TArray<FEdge> mazeEdges = mstEdges;
-
-	// Filter out the edges that are not part of the MST
-	TArray<FEdge> remainingEdges;
-	for (const FEdge& edge : originalEdges)
-	{
-		if (!mstEdges.Contains(edge))
-		{
-			remainingEdges.Add(edge);
-		}
-	}
-	
-	// Shuffle remaining edges to randomize their order
-	int32 numEdges = remainingEdges.Num();
-	for (int32 i = numEdges - 1; i > 0; --i)
-	{
-		int32 j = FMath::RandRange(0, i); // Random index from 0 to i
-		remainingEdges.Swap(i, j); // Swap elements to shuffle
-	}
-
-	// Add random remaining edges to the maze
-	for (const FEdge& edge : remainingEdges)
-	{
-		if (FMath::FRand() < additionalEdgeProbability)
-		{
-			mazeEdges.Add(edge);
-		}
-	}
-
-	return mazeEdges;
-}
-
 /*
  * @brief Generate rooms using procedural generation
  */
@@ -947,16 +1064,16 @@ void ADungeonGenerator::GenerateProcGenRooms()
 	TArray<FVector> locations = TArray<FVector>();
 	FVector scale = FVector::OneVector;
 	FVector totalScale = FVector::OneVector;
-	GetRandomRoomProperties(locations, totalScale);
+	GetRandomRoomProperties(roomStream, locations, totalScale);
 
 	// First, check if the room compound fits in the dungeon
 	bool canAdd = true;
 
 	const FVector centerRoomLocation = locations[0];
-	const int index = FMath::RandRange(0, RoomList.Num() - 1);
+	const int index = roomStream.RandRange(0, RoomList.Num() - 1);
 	const TSubclassOf<AMainRoom> newRoom = RoomList[index];
 
-	FBox defaultBounds = newRoom->GetDefaultObject<AMainRoom>()->GetComponentsBoundingBox();
+	FBox defaultBounds = GetPrefabInfo(newRoom).ComponentsBounds;
 	FVector defaultOrigin, defaultExtent;
 	defaultOrigin = defaultBounds.GetCenter();
 	defaultExtent = DefaultRoomSize * 0.5f;
@@ -966,21 +1083,14 @@ void ADungeonGenerator::GenerateProcGenRooms()
 	FBox totalBounds = FBox(centerOrigin - centerExtent, centerOrigin + centerExtent);
 
 	// Check if the new room intersects with existing rooms
-	for (auto& roomGroup : spawnedRooms)
+	const FDungeonRoomTable& rooms = layout.RoomTable;
+	for (int roomIndex = 0; roomIndex < rooms.Num(); ++roomIndex)
 	{
-		for (auto& room : roomGroup)
+		if (rooms.Groups[roomIndex] != INDEX_NONE && ChckeRoomIntersection(rooms.PlacementBounds[roomIndex], totalBounds))
 		{
-			const FBox bounds = FBox(
-				room->GetActorLocation() - room->Scale * defaultExtent,
-				room->GetActorLocation() + room->Scale * defaultExtent
-			);
-
-			if (ChckeRoomIntersection(bounds, totalBounds))
-			{
-				UE_LOG(LogTemp, Warning, TEXT("Room location overlap!"));
-				canAdd = false;
-				break;
-			}
+			UE_LOG(LogTemp, Warning, TEXT("Room location overlap!"));
+			canAdd = false;
+			break;
 		}
 	}
 
@@ -997,6 +1107,11 @@ void ADungeonGenerator::GenerateProcGenRooms()
 		canAdd = false;
 	}
 
+	if (!canAdd)
+	{
+		INC_DWORD_STAT(STAT_DungeonGenRoomsRejected);
+	}
+	
 	// If room location is valid, spawn the room 
 	if (canAdd)
 	{
@@ -1004,7 +1119,7 @@ void ADungeonGenerator::GenerateProcGenRooms()
 		scale = FVector(scale.X, scale.Y, totalScale.Z);
 
 		// Add a new room group
-		spawnedRooms.Add(TArray<AMainRoom*>());
+		layout.RoomGroups.Add(TArray<int>());
 
 		// Increase the ground floor room count
 		RoomCountCalculation(centerRoomLocation);
@@ -1016,35 +1131,30 @@ void ADungeonGenerator::GenerateProcGenRooms()
 			FVector newExtent = scale * defaultExtent + sizeGap;
 			FBox newBounds = FBox(newOrigin - newExtent, newOrigin + newExtent);
 
-			FTransform transform = FTransform(FRotator::ZeroRotator, location, FVector::OneVector);
-			AMainRoom* newRoomSpawned = SpawnStructure(transform, newRoom);
+			FDungeonRoomData newRoomData;
+			newRoomData.PrefabType = EDungeonPrefabType::ROOM;
+			newRoomData.PrefabIndex = index;
+			newRoomData.Transform = FTransform(FRotator::ZeroRotator, location, FVector::OneVector);
+			newRoomData.Scale = scale;
+			newRoomData.Bounds = newBounds;
+			
+			const int roomIndex = layout.AddRoom(newRoomData, currentRoomGroupIndex, static_cast<int>(location.Z), GetPlacementBounds(location, scale));
+			INC_DWORD_STAT(STAT_DungeonGenRoomsPlaced);
 
-			if (newRoomSpawned)
+			// Set the structure type of the room in the grid
+			if (DefaultRoomSize.X > 1 && DefaultRoomSize.Y > 1 && DefaultRoomSize.Z > 1)
 			{
-				newRoomSpawned->InitInfo(transform, scale, newBounds);
-				spawnedRooms[currentRoomGroupIndex].Add(newRoomSpawned);
-				ReplicatedRoomLocations.Add(location);
-
-				if (!floorRoomMap.Contains(location.Z))
-				{
-					floorRoomMap.Add(location.Z, TArray<AMainRoom*>());
-				}
-				floorRoomMap[location.Z].Add(newRoomSpawned);
-
-				// Set the structure type of the room in the grid
-				if (DefaultRoomSize.X > 1 && DefaultRoomSize.Y > 1 && DefaultRoomSize.Z > 1)
-				{
-					TArray<FVector> posInRoom = GetAllIntegerPointsInBox(newRoomSpawned->Bounds);
-					for (auto& pos : posInRoom)
-					{
-						grid[pos] = EStructureType::ROOM;
-					}
-				}
-				else
+				TArray<FVector> posInRoom = GetAllIntegerPointsInBox(newBounds);
+				for (auto& pos : posInRoom)
 				{
-					grid[location] = EStructureType::ROOM;
+					layout.Grid[pos] = EStructureType::ROOM;
 				}
 			}
+			else
+			{
+				layout.Grid[location] = EStructureType::ROOM;
+			}
+			layout.SetRoomAnchor(GetRoomAnchor(newRoomData.Bounds), roomIndex);
 		}
 
 		// Increase the room group index cuz this group is done
@@ -1061,16 +1171,17 @@ void ADungeonGenerator::GeneratePremadeRooms()
 	TArray<FVector> locations = TArray<FVector>();
 	FVector scale = FVector::OneVector;
 	FVector totalScale = FVector::OneVector;
-	GetRandomRoomProperties(locations, totalScale);
+	GetRandomRoomProperties(roomStream, locations, totalScale);
 
 	// First, check if the room compound fits in the dungeon
 	bool canAdd = true;
 
 	const FVector centerRoomLocation = locations[0];
-	const int index = FMath::RandRange(0, RoomList.Num() - 1);
+	const int index = roomStream.RandRange(0, RoomList.Num() - 1);
 	const TSubclassOf<AMainRoom> newRoom = PremadeRoomList[index];
 
-	FBox defaultBounds = newRoom->GetDefaultObject<AMainRoom>()->Bounds;
+	const FDungeonPrefabInfo& prefabInfo = GetPrefabInfo(newRoom);
+	FBox defaultBounds = prefabInfo.Bounds;
 	FVector defaultOrigin, defaultExtent;
 	defaultOrigin = defaultBounds.GetCenter();
 	defaultExtent = defaultBounds.GetExtent();
@@ -1080,9 +1191,10 @@ void ADungeonGenerator::GeneratePremadeRooms()
 	FBox newBounds = FBox(centerOrigin - centerExtent, centerOrigin + centerExtent);
 
 	// Check if the new room intersects with existing rooms
-	for(auto& bound : premadeBounds)
+	const FDungeonRoomTable& rooms = layout.RoomTable;
+	for(int roomIndex = 0; roomIndex < rooms.Num(); ++roomIndex)
 	{
-		if(ChckeRoomIntersection(bound, newBounds))
+		if(rooms.PrefabTypes[roomIndex] == EDungeonPrefabType::PREMADE && ChckeRoomIntersection(rooms.PlacementBounds[roomIndex], newBounds))
 		{
 			UE_LOG(LogTemp, Warning, TEXT("Room location overlap!"));
 			canAdd = false;
@@ -1103,68 +1215,68 @@ void ADungeonGenerator::GeneratePremadeRooms()
 		canAdd = false;
 	}
 
+	if (!canAdd)
+	{
+		INC_DWORD_STAT(STAT_DungeonGenRoomsRejected);
+	}
+	
 	// If room location is valid, spawn the room
 	if (canAdd)
 	{
-		// Add new bounds to the list
-		premadeBounds.Add(newBounds);
-
 		// Set tiles in room as non-walkable first
 		TArray<FVector> stopInRoom = GetAllIntegerPointsInBox(newBounds);
 		for (auto& pos : stopInRoom)
 		{
-			grid[pos] = EStructureType::STOP;
+			layout.Grid[pos] = EStructureType::STOP;
 		}
 		
 		// Update scale Z for the room
 		scale = FVector(scale.X, scale.Y, totalScale.Z);
 		
 		// Add a new room group
-		spawnedRooms.Add(TArray<AMainRoom*>());
+		layout.RoomGroups.Add(TArray<int>());
 
 		// Increase floor room count
 		RoomCountCalculation(centerRoomLocation);
 		
 		// Generate rooms in the group
-		FTransform transform = FTransform(FRotator::ZeroRotator, centerRoomLocation, FVector::OneVector);
-		AMainRoom* newRoomSpawned = SpawnStructure(transform, newRoom);
-		if (newRoomSpawned)
+		FDungeonRoomData newRoomData;
+		newRoomData.PrefabType = EDungeonPrefabType::PREMADE;
+		newRoomData.PrefabIndex = index;
+		newRoomData.Transform = FTransform(FRotator::ZeroRotator, centerRoomLocation, FVector::OneVector);
+		newRoomData.Scale = scale;
+		newRoomData.Bounds = newBounds;
+		
+		const int premadeIndex = layout.AddRoom(newRoomData, INDEX_NONE, INDEX_NONE, newBounds);
+		layout.PremadeRooms.Add(premadeIndex, TArray<int>());
+		INC_DWORD_STAT(STAT_DungeonGenRoomsPlaced);
+		
+		for(auto& innerPos : prefabInfo.InnerPaths)
 		{
-			newRoomSpawned->InitInfo(transform, scale, newBounds);
-			ReplicatedRoomLocations.Add(centerRoomLocation);
-			cleanupMap.Add(newRoomSpawned, TArray<AMainRoom*>());
+			FVector pathPos = innerPos.GridSnap(DungeonUnit);
+			FTransform pathTransform = FTransform(FRotator::ZeroRotator, pathPos, FVector::OneVector);
 			
-			for(auto& innerPos : newRoomSpawned->InnerPaths)
-			{
-				FVector pathPos = innerPos.GridSnap(DungeonUnit);
-				FTransform pathTransform = FTransform(FRotator::ZeroRotator, pathPos, FVector::OneVector);
-				AMainRoom* newPathSpawned = SpawnStructure(pathTransform, PathTileInPremadeRoom, false);
-				
-				FBox defaultPathBounds = PathTileInPremadeRoom->GetDefaultObject<AMainRoom>()->Bounds;
-				FVector defaultPathOrigin, defaultPathExtent;
-				defaultPathOrigin = defaultBounds.GetCenter();
-				defaultPathExtent = DefaultRoomSize * 0.5f;
-				
-				FVector newPathOrigin = pathPos + defaultPathOrigin;
-				FVector newPathExtent = scale * defaultPathExtent + sizeGap;
-				FBox nePathBounds = FBox(newPathOrigin - newPathExtent, newPathOrigin + newPathExtent);
-
-				if (newPathSpawned)
-				{
-					newPathSpawned->InitInfo(pathTransform, scale, nePathBounds);
-					spawnedRooms[currentRoomGroupIndex].Add(newPathSpawned);
-					cleanupMap[newRoomSpawned].Add(newPathSpawned);
-
-					if (!floorRoomMap.Contains(centerRoomLocation.Z))
-					{
-						floorRoomMap.Add(centerRoomLocation.Z, TArray<AMainRoom*>());
-					}
-					floorRoomMap[centerRoomLocation.Z].Add(newPathSpawned);
-
-					// Set the structure type of the inner path in the grid
-					grid[pathPos] = EStructureType::ROOM;
-				}
-			}
+			FVector defaultPathOrigin, defaultPathExtent;
+			defaultPathOrigin = defaultBounds.GetCenter();
+			defaultPathExtent = DefaultRoomSize * 0.5f;
+			
+			FVector newPathOrigin = pathPos + defaultPathOrigin;
+			FVector newPathExtent = scale * defaultPathExtent + sizeGap;
+			FBox nePathBounds = FBox(newPathOrigin - newPathExtent, newPathOrigin + newPathExtent);
+
+			FDungeonRoomData newPathData;
+			newPathData.PrefabType = EDungeonPrefabType::PREMADE_PATH;
+			newPathData.Transform = pathTransform;
+			newPathData.Scale = scale;
+			newPathData.Bounds = nePathBounds;
+			newPathData.CheckCollision = false;
+
+			const int pathIndex = layout.AddRoom(newPathData, currentRoomGroupIndex, static_cast<int>(centerRoomLocation.Z), GetPlacementBounds(pathPos, scale));
+			layout.PremadeRooms[premadeIndex].Add(pathIndex);
+
+			// Set the structure type of the inner path in the grid
+			layout.Grid[pathPos] = EStructureType::ROOM;
+			layout.SetRoomAnchor(GetRoomAnchor(newPathData.Bounds), pathIndex);
 		}
 
 		// Increase the room group index cuz this group is done
@@ -1222,16 +1334,28 @@ void ADungeonGenerator::RoomCountCalculation(const FVector& centerRoomLocation)
  */
 void ADungeonGenerator::FindPossibleHallwaysNormal()
 {
-	TArray<FEdge> uniqueEdges;
+	TArray<FDungeonEdge> uniqueEdges;
 	TArray<FVector3d> points = roomVertices;
 	TArray<FIntVector4> tetrahedra = delaunay.GetTetrahedra();
 
-	if(tetrahedra.IsEmpty())
+	if(tetrahedra.IsEmpty() && !TriangulateRoomGroups)
 	{
 		UE_LOG(LogTemp, Error, TEXT("Tetrahedra is empty or null!"));
 		return;
 	}
 
+	// Less than four groups or groups on one plane can't be triangulated, every pair may be connected then
+	if(tetrahedra.IsEmpty())
+	{
+		for(int i = 0; i<points.Num(); ++i)
+		{
+			for(int j = i + 1; j<points.Num(); ++j)
+			{
+				uniqueEdges.Add(FDungeonEdge(points[i], points[j]));
+			}
+		}
+	}
+
 	// Extract edges from each tetrahedron
 	for (const FIntVector4& tetrahedron : tetrahedra)
 	{
@@ -1243,24 +1367,24 @@ void ADungeonGenerator::FindPossibleHallwaysNormal()
 		};
 
 		// Add all 6 unique edges of the tetrahedron
-		uniqueEdges.Add(FEdge(verts[0], verts[1]));
-		uniqueEdges.Add(FEdge(verts[0], verts[2]));
-		uniqueEdges.Add(FEdge(verts[0], verts[3]));
-		uniqueEdges.Add(FEdge(verts[1], verts[2]));
-		uniqueEdges.Add(FEdge(verts[1], verts[3]));
-		uniqueEdges.Add(FEdge(verts[2], verts[3]));
+		uniqueEdges.Add(FDungeonEdge(verts[0], verts[1]));
+		uniqueEdges.Add(FDungeonEdge(verts[0], verts[2]));
+		uniqueEdges.Add(FDungeonEdge(verts[0], verts[3]));
+		uniqueEdges.Add(FDungeonEdge(verts[1], verts[2]));
+		uniqueEdges.Add(FDungeonEdge(verts[1], verts[3]));
+		uniqueEdges.Add(FDungeonEdge(verts[2], verts[3]));
 	}
 
 	// Save the MST
-	selectedEdges = MinimumSpanningTree(uniqueEdges, points[0]);
+	selectedEdges = DungeonGraph::MinimumSpanningTree(uniqueEdges, points[0]);
 
 	// Add random edges to the MST to create a more complex dungeon
-	selectedEdges = AddRandomEdgesToMST(uniqueEdges, selectedEdges, LoopProbability);
+	selectedEdges = DungeonGraph::AddRandomEdges(MakeRandomStream(EDungeonGenerationStage::HALLWAY_CANDIDATES), uniqueEdges, selectedEdges, LoopProbability);
 
 	// DEBUG LINES
 	// if(DebugMode)
 	// {
-	// 	for (const FEdge& edge : selectedEdges)
+	// 	for (const FDungeonEdge& edge : selectedEdges)
 	// 	{
 	// 		DrawDebugLine(GetWorld(), edge.Vertex[0], edge.Vertex[1], FColor::Blue, true, -1, 0, 0.15f);
 	// 	}
@@ -1277,7 +1401,7 @@ void ADungeonGenerator::FindPossibleHallwaysFloorBased()
 		TArray<FVector> vertices = floor.Value;
 		delaunay.Triangulate(vertices );
 		
-		TArray<FEdge> uniqueEdges;
+		TArray<FDungeonEdge> uniqueEdges;
 		TArray<FVector3d> points = vertices ;
 		TArray<FIntVector4> tetrahedra = delaunay.GetTetrahedra();
 
@@ -1298,29 +1422,29 @@ void ADungeonGenerator::FindPossibleHallwaysFloorBased()
 			};
 
 			// Add all 6 unique edges of the tetrahedron
-			uniqueEdges.Add(FEdge(verts[0], verts[1]));
-			uniqueEdges.Add(FEdge(verts[0], verts[2]));
-			uniqueEdges.Add(FEdge(verts[0], verts[3]));
-			uniqueEdges.Add(FEdge(verts[1], verts[2]));
-			uniqueEdges.Add(FEdge(verts[1], verts[3]));
-			uniqueEdges.Add(FEdge(verts[2], verts[3]));
+			uniqueEdges.Add(FDungeonEdge(verts[0], verts[1]));
+			uniqueEdges.Add(FDungeonEdge(verts[0], verts[2]));
+			uniqueEdges.Add(FDungeonEdge(verts[0], verts[3]));
+			uniqueEdges.Add(FDungeonEdge(verts[1], verts[2]));
+			uniqueEdges.Add(FDungeonEdge(verts[1], verts[3]));
+			uniqueEdges.Add(FDungeonEdge(verts[2], verts[3]));
 		}
 
 		// Save the MST
 		if(!floorEdgeMap.Contains(floor.Key))
 		{
-			floorEdgeMap.Add(floor.Key, TArray<FEdge>());
+			floorEdgeMap.Add(floor.Key, TArray<FDungeonEdge>());
 		}
-		floorEdgeMap[floor.Key] = MinimumSpanningTree(uniqueEdges, points[0]);
+		floorEdgeMap[floor.Key] = DungeonGraph::MinimumSpanningTree(uniqueEdges, points[0]);
 		
 		
 		// Add random edges to the MST to create a more complex dungeon
-		floorEdgeMap[floor.Key] = AddRandomEdgesToMST(uniqueEdges, floorEdgeMap[floor.Key], LoopProbability);
+		floorEdgeMap[floor.Key] = DungeonGraph::AddRandomEdges(MakeRandomStream(EDungeonGenerationStage::HALLWAY_CANDIDATES, floor.Key), uniqueEdges, floorEdgeMap[floor.Key], LoopProbability);
 
 		// DEBUG LINES
 		// if(DebugMode)
 		// {
-		// 	for (const FEdge& edge : floorEdgeMap[floor.Key])
+		// 	for (const FDungeonEdge& edge : floorEdgeMap[floor.Key])
 		// 	{
 		// 		DrawDebugLine(GetWorld(), edge.Vertex[0], edge.Vertex[1], FColor::Blue, true, -1, 0, 0.15f);
 		// 	}
@@ -1329,420 +1453,1588 @@ void ADungeonGenerator::FindPossibleHallwaysFloorBased()
 }
 
 /*
- * @brief Generate normal hallways
+ * @brief Prepare the pathfinder and the list of hallways to route
  */
-void ADungeonGenerator::GenerateNormalHallways()
+void ADungeonGenerator::BeginHallways()
 {
-	//DEBUG
-	int DEBUG_COUNTER = 0;	
+	TRACE_CPUPROFILER_EVENT_SCOPE(DungeonGen_QueueHallways);
 
-	for(auto& edge : selectedEdges)
+	pathfinder.Reset(DungeonSize, DungeonUnit);
+	pathfinder.ResetStats(SlowPathQueryCount);
+	hallwayQueue.Empty();
+	hallwayCursor = 0;
+	hallwayDoorLinks.Reset();
+	
+	if(IsDungeonFloorBased)
 	{
-		FVector& startPos = edge.Vertex[0];
-		FVector& endPos = edge.Vertex[1];
-
-		DEBUG_COUNTER++;
-		UE_LOG(LogTemp, Verbose, TEXT("EDGES_COUNTER: %d"), DEBUG_COUNTER);
-		
-		// Get the path between the two rooms
-		TArray<FVector> path = pathfinder.FindPath(startPos, endPos, [&](const DungeonNode& a, const DungeonNode& b)
-		{
-			return CostFunction(a, b, endPos);
-		});
-
-		// If the path is valid, set the structure type
-		if(path.Num() > 0)
-		{
-			for(int i = 0; i<path.Num(); ++i)
-			{
-				FVector current = path[i];
-
-				// If the position on the grid is empty, set it to hallway
-				if(grid[current] == EStructureType::NONE)
-				{
-					grid[current] = EStructureType::HALLWAY;
-				}
-
-				if(i>0)
-				{
-					FVector pre = path[i-1];
-					FVector delta = current - pre;
-					
-					FVector spawnDirection = delta.GetSafeNormal2D();
-					float YawRotation = FMath::Atan2(spawnDirection.Y, spawnDirection.X) * (180.0f / PI);
-
-					//if(IsRoomProcGen)
-					//{
-						// Set door positions of rooms
-						if(grid[current] != EStructureType::ROOM && grid[current] != EStructureType::NONE && grid[current] != EStructureType::STOP)
-						{
-							if(grid[pre] == EStructureType::ROOM)
-							{
-								for (auto& roomGroup : spawnedRooms)
-								{
-									for(auto& room : roomGroup)
-									{
-										if(room->Bounds.GetCenter() == pre)
-										{
-											// Door is between the current and previous position
-											FVector doorPoint = pre + delta * 0.5f;
-											room->AddDoorPoint(doorPoint);
-											room->IsConnectedToHallway = true;
-										}
-									}
-								}
-							}
-						}
-						else if(grid[current] == EStructureType::ROOM)
-						{
-							if(grid[pre] != EStructureType::ROOM && grid[pre] != EStructureType::NONE && grid[pre] != EStructureType::STOP)
-							{
-								for (auto& roomGroup : spawnedRooms)
-								{
-									for(auto& room : roomGroup)
-									{
-										if(room->Bounds.GetCenter() == current)
-										{
-											// Door is between the current and previous position
-											FVector doorPoint = pre + delta * 0.5f;
-											room->AddDoorPoint(doorPoint);
-											room->IsConnectedToHallway = true;
-										}
-									}
-								}
-							}
-						}
-					//}
-					
-					if(delta.Z != 0)
-					{
-						int xDir = FMath::Clamp(FMath::RoundToInt(delta.X), -DungeonUnit, DungeonUnit);
-						int yDir = FMath::Clamp(FMath::RoundToInt(delta.Y), -DungeonUnit, DungeonUnit);
-						FVector verticalOffset = FVector(0, 0, delta.Z);
-						FVector horizontalOffset = FVector(xDir, yDir, 0);
-
-						grid[pre + horizontalOffset] = EStructureType::STAIRS;
-						grid[pre + horizontalOffset*2] = EStructureType::STAIRS;
-						grid[pre + horizontalOffset + verticalOffset] = EStructureType::STAIRS;
-						grid[pre + horizontalOffset*2 + verticalOffset] = EStructureType::STAIRS;
-
-						// Spawn stairs
-						if(StairsList.Num()>0 && (!DebugMode || (DebugMode && DebugWithModels)))
-						{
-							AMainRoom* spawnedStair = nullptr;
-							// Goes up
-							if(delta.Z > 0)
-							{
-								YawRotation += 90.f;
-								FRotator spawnRot = FRotator(0, YawRotation, 0);
-								FTransform transform = FTransform(spawnRot, pre + horizontalOffset, FVector::OneVector);
-								spawnedStair = SpawnStructure(transform, StairsList[0], false);
-								if(!spawnedStair)
-									continue;
-								
-								spawnedStair->InitInfo(transform, FVector::OneVector, spawnedStair->GetComponentsBoundingBox());
-							}
-							// Goes down
-							else if (delta.Z <0)
-							{
-								YawRotation -= 90.f;
-								FRotator spawnRot = FRotator(0, YawRotation, 0);
-								FTransform transform = FTransform(spawnRot, pre + horizontalOffset*2 + verticalOffset, FVector::OneVector);
-								spawnedStair = SpawnStructure(transform, StairsList[0], false);
-								if(!spawnedStair)
-									continue;
-								
-								spawnedStair->InitInfo(transform, FVector::OneVector, spawnedStair->GetComponentsBoundingBox());
-							}
-						}
-					}
-				}
-			}
-
-			// Spawn hallways
-			FVector prePos = path[0];
-			for(auto& pos : path)
-			{
-				FVector curPos = pos;
-				if((!DebugMode || (DebugMode && DebugWithModels)))
-				{
-					if(grid[curPos] == EStructureType::HALLWAY && HallwayList.Num()>0)
-					{
-						FTransform transform = FTransform(FRotator::ZeroRotator, pos, FVector::OneVector);
-						AMainRoom* spawnedHallway = SpawnStructure(transform, HallwayList[0], false);
-						hallwaysVertices.Add(pos);
-						if(!spawnedHallway)
-							continue;
-						
-						spawnedHallway->InitInfo(transform, FVector::OneVector, spawnedHallway->GetComponentsBoundingBox());
-					}
-				}
+		QueueFloorBasedHallways();
+	}
+	else
+	{
+		QueueNormalHallways();
+	}
 
-				if(DebugMode)
-				{
-					DrawDebugLine(GetWorld(), prePos, curPos, FColor::Red, true, -1, 0, 0.15f);
-					prePos = curPos;
-				}
-				
-			}
-		}
+	// The layout is copied before any hallway is carved
+	isCapturingPaths = CaptureHallwaySearches;
+	if(isCapturingPaths)
+	{
+		pathCapture.Reset();
+		pathCapture.Seed = Seed;
+		pathCapture.LayoutKey = layoutCacheKey.Hash;
+		pathCapture.DungeonUnit = DungeonUnit;
+		pathCapture.DungeonSize = DungeonSize;
+		pathCapture.IsDungeonFloorBased = IsDungeonFloorBased;
+		pathCapture.BaseCost = BaseCost;
+		pathCapture.RoomExtraCost = RoomExtraCost;
+		pathCapture.NoneExtraCost = NoneExtraCost;
+		pathCapture.ChangeFloorExtraCost = ChangeFloorExtraCost;
+		pathCapture.Requests = hallwayQueue;
+		// The snapshot travels inside the capture, only the hash of the key is stored with it
+		FDungeonLayoutCache::SaveToBuffer(layout, FDungeonLayoutCacheKey(pathCapture.LayoutKey), pathCapture.LayoutSnapshot);
 	}
 }
 
 /*
- * @brief Generate floor based hallways
+ * @brief Queue normal hallways
  */
-void ADungeonGenerator::GenerateFloorBasedHallways()
+void ADungeonGenerator::QueueNormalHallways()
 {
-	//DEBUG
-	int DEBUG_COUNTER = 0;
+	for(auto& edge : selectedEdges)
+	{
+		FHallwayRequest request;
+		request.Edge = TriangulateRoomGroups ? SelectDoorCandidates(edge) : edge;
+		request.CanChangeFloors = true;
+		hallwayQueue.Add(request);
+	}
+}
 
+/*
+ * @brief Queue floor based hallways
+ */
+void ADungeonGenerator::QueueFloorBasedHallways()
+{
 	for(auto& floor : floorEdgeMap)
 	{
 		int stairCount = 0;
 		for(auto& edge : floor.Value)
 		{
-			FVector& startPos = edge.Vertex[0];
-			FVector& endPos = edge.Vertex[1];
-
-			TArray<FVector> path;
-			if(endPos.Z == startPos.Z)
+			FHallwayRequest request;
+			request.Edge = edge;
+			
+			if(edge.Vertex[1].Z == edge.Vertex[0].Z)
 			{
 				// Find path if there is no stairs
-				path = pathfinder.FindPath(startPos, endPos, [&](const DungeonNode& a, const DungeonNode& b)
-				{
-					return CostFunction(a, b, endPos);
-				}, false);
+				request.CanChangeFloors = false;
 			}
 			else if(stairCount < MaxStairCaseCount)
 			{
 				// Find path if there are stairs
-				path = pathfinder.FindPath(startPos, endPos, [&](const DungeonNode& a, const DungeonNode& b)
-				{
-					return CostFunction(a, b, endPos);
-				}, true);
-
+				request.CanChangeFloors = true;
 				stairCount++;
 			}
-
-			if(path.Num() > 0)
+			else
 			{
-				for(int i = 0; i<path.Num(); ++i)
-				{
-					FVector current = path[i];
+				continue;
+			}
 
-					// If the position on the grid is empty, set it to hallway
-					if(grid[current] == EStructureType::NONE)
-					{
-						grid[current] = EStructureType::HALLWAY;
-					}
+			hallwayQueue.Add(request);
+		}
+	}
+}
 
-					if(i>0)
-					{
-						FVector pre = path[i-1];
-						FVector delta = current - pre;
-						
-						FVector spawnDirection = delta.GetSafeNormal2D();
-						float YawRotation = FMath::Atan2(spawnDirection.Y, spawnDirection.X) * (180.0f / PI);
-
-						//if(IsRoomProcGen)
-						//{
-							// Set door positions the room
-							if(grid[current] != EStructureType::ROOM && grid[current] != EStructureType::NONE && grid[current] != EStructureType::STOP)
-							{
-								if(grid[pre] == EStructureType::ROOM)
-								{
-									for (auto& roomGroup : spawnedRooms)
-									{
-										for(auto& room : roomGroup)
-										{
-											FVector roomPos = FVector(room->Bounds.GetCenter().X, room->Bounds.GetCenter().Y, room->Bounds.Min.Z);
-											if(roomPos == pre)
-											{
-												// Door is between the current and previous position
-												FVector doorPoint = pre + delta * 0.5f;
-												room->AddDoorPoint(doorPoint);
-												room->IsConnectedToHallway = true;
-											}
-										}
-									}
-								}
-							}
-							else if(grid[current] == EStructureType::ROOM)
-							{
-								if(grid[pre] != EStructureType::ROOM && grid[pre] != EStructureType::NONE && grid[pre] != EStructureType::STOP)
-								{
-									for (auto& roomGroup : spawnedRooms)
-									{
-										for(auto& room : roomGroup)
-										{
-											FVector roomPos = FVector(room->Bounds.GetCenter().X, room->Bounds.GetCenter().Y, room->Bounds.Min.Z);
-											if(roomPos == current)
-											{
-												// Door is between the current and previous position
-												FVector doorPoint = pre + delta * 0.5f;
-												room->AddDoorPoint(doorPoint);
-												room->IsConnectedToHallway = true;
-											}
-										}
-									}
-								}
-							}
-						//}
-						
-						if(delta.Z != 0)
-						{
-							int xDir = FMath::Clamp(FMath::RoundToInt(delta.X), -DungeonUnit, DungeonUnit);
-							int yDir = FMath::Clamp(FMath::RoundToInt(delta.Y), -DungeonUnit, DungeonUnit);
-							FVector verticalOffset = FVector(0, 0, delta.Z);
-							FVector horizontalOffset = FVector(xDir, yDir, 0);
-
-							grid[pre + horizontalOffset] = EStructureType::STAIRS;
-							grid[pre + horizontalOffset*2] = EStructureType::STAIRS;
-							grid[pre + horizontalOffset + verticalOffset] = EStructureType::STAIRS;
-							grid[pre + horizontalOffset*2 + verticalOffset] = EStructureType::STAIRS;
-
-							// Spawn stairs
-							if(StairsList.Num()>0 && (!DebugMode || (DebugMode && DebugWithModels)))
-							{
-								AMainRoom* spawnedStair = nullptr;
-								// Goes up
-								if(delta.Z > 0)
-								{
-									YawRotation += 90.f;
-									FRotator spawnRot = FRotator(0, YawRotation, 0);
-									FTransform transform = FTransform(spawnRot, pre + horizontalOffset, FVector::OneVector);
-									spawnedStair = SpawnStructure(transform, StairsList[0], false);
-									if(!spawnedStair)
-										continue;
-									
-									spawnedStair->InitInfo(transform, FVector::OneVector, spawnedStair->GetComponentsBoundingBox());
-								}
-								// Goes down
-								else if (delta.Z <0)
-								{
-									YawRotation -= 90.f;
-									FRotator spawnRot = FRotator(0, YawRotation, 0);
-									FTransform transform = FTransform(spawnRot, pre + horizontalOffset*2 + verticalOffset, FVector::OneVector);
-									spawnedStair = SpawnStructure(transform, StairsList[0], false);
-									if(!spawnedStair)
-										continue;
-									
-									spawnedStair->InitInfo(transform, FVector::OneVector, spawnedStair->GetComponentsBoundingBox());
-								}
-							}
-						}
+/*
+ * @brief Get the vertex of a room group, the anchor of the room closest to the center of the group
+ * @param int groupIndex
+ * @return FVector Anchor of a room so hallways of the group still start in a room cell
+ */
+FVector ADungeonGenerator::GetRoomGroupVertex(int groupIndex) const
+{
+	const TArray<int>& roomGroup = layout.RoomGroups[groupIndex];
+	
+	FVector center = FVector::ZeroVector;
+	for(const int roomIndex : roomGroup)
+	{
+		center += GetRoomAnchor(layout.RoomTable.Bounds[roomIndex]);
+	}
+	center /= roomGroup.Num();
+
+	FVector vertex = GetRoomAnchor(layout.RoomTable.Bounds[roomGroup[0]]);
+	for(const int roomIndex : roomGroup)
+	{
+		const FVector anchor = GetRoomAnchor(layout.RoomTable.Bounds[roomIndex]);
+		if(FVector::DistSquared(anchor, center) < FVector::DistSquared(vertex, center))
+		{
+			vertex = anchor;
+		}
+	}
+	return vertex;
+}
+
+/*
+ * @brief Attach a hallway between two group vertices to the closest rooms of the groups
+ * @param const FDungeonEdge& edge Between two group vertices
+ * @return FDungeonEdge Between the anchors of the closest pair of rooms
+ */
+FDungeonEdge ADungeonGenerator::SelectDoorCandidates(const FDungeonEdge& edge) const
+{
+	const int* groupA = vertexGroupMap.Find(edge.Vertex[0]);
+	const int* groupB = vertexGroupMap.Find(edge.Vertex[1]);
+	if(!groupA || !groupB)
+		return edge;
+
+	FDungeonEdge result = edge;
+	double minDistance = FVector::DistSquared(edge.Vertex[0], edge.Vertex[1]);
+	for(const int roomA : layout.RoomGroups[*groupA])
+	{
+		const FVector anchorA = GetRoomAnchor(layout.RoomTable.Bounds[roomA]);
+		for(const int roomB : layout.RoomGroups[*groupB])
+		{
+			const FVector anchorB = GetRoomAnchor(layout.RoomTable.Bounds[roomB]);
+			const double distance = FVector::DistSquared(anchorA, anchorB);
+			if(distance < minDistance)
+			{
+				minDistance = distance;
+				result = FDungeonEdge(anchorA, anchorB);
+			}
+		}
+	}
+	return result;
+}
+
+/*
+ * @brief Route the current hallway, the search can be suspended and resumed on the next call
+ * @param int maxExpansions Number of pathfinder expansions allowed in this call
+ * @return bool False if there is no hallway left to route
+ */
+bool ADungeonGenerator::RouteNextHallway(int maxExpansions)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(DungeonGen_RouteHallway);
+
+	if(hallwayCursor >= hallwayQueue.Num())
+		return false;
+
+	const FHallwayRequest& request = hallwayQueue[hallwayCursor];
+	
+	// Start a new search if the previous one is done
+	if(pathfinder.GetSearchStatus() != EPathSearchStatus::RUNNING)
+	{
+		UE_LOG(LogTemp, Verbose, TEXT("EDGES_COUNTER: %d"), hallwayCursor + 1);
+		
+		const FVector endPos = request.Edge.Vertex[1];
+		pathfinder.BeginSearch(request.Edge.Vertex[0], endPos, [this, endPos](const DungeonNode& a, const DungeonNode& b)
+		{
+			return CostFunction(a, b, endPos);
+		}, request.CanChangeFloors);
+	}
+
+	// The search yielded, continue next time
+	if(pathfinder.StepSearch(maxExpansions) == EPathSearchStatus::RUNNING)
+		return true;
+
+	if(pathfinder.GetSearchStatus() == EPathSearchStatus::FAILED)
+	{
+		failedHallwayCount++;
+		INC_DWORD_STAT(STAT_DungeonGenEdgesFailed);
+	}
+	else
+	{
+		INC_DWORD_STAT(STAT_DungeonGenEdgesRouted);
+	}
+
+	if(isCapturingPaths)
+	{
+		pathCapture.AddResult(pathfinder.GetSearchResult(), pathfinder.GetLastQueryStats());
+	}
+	
+	CarveHallwayPath(pathfinder.GetSearchResult());
+	hallwayCursor++;
+	
+	return true;
+}
+
+/*
+ * @brief Add a door to the room anchored at a cell of a hallway path
+ * @param const FVector& anchor Cell of the path inside the room
+ * @param const FVector& doorPoint Door between the room cell and the hallway cell
+ */
+void ADungeonGenerator::AddRoomDoorPoint(const FVector& anchor, const FVector& doorPoint)
+{
+	const int roomIndex = layout.GetRoomAtAnchor(anchor);
+	if(roomIndex == INDEX_NONE)
+		return;
+
+	FDungeonRoomData& room = layout.Rooms[roomIndex];
+	if(GetRoomAnchor(room.Bounds) != anchor)
+		return;
+	
+	room.DoorPoints.AddUnique(doorPoint);
+	room.IsConnectedToHallway = true;
+
+	// The path is added to the layout once it is carved
+	hallwayDoorLinks.Add(FIntPoint(roomIndex, layout.HallwayPaths.Num()));
+}
+
+/*
+ * @brief Get the bounds new rooms may not intersect, rooms keep their default size apart
+ * @param const FVector& location of the room
+ * @param const FVector& scale of the room
+ * @return FBox
+ */
+FBox ADungeonGenerator::GetPlacementBounds(const FVector& location, const FVector& scale) const
+{
+	const FVector extent = scale * DefaultRoomSize * 0.5f;
+	return FBox(location - extent, location + extent);
+}
+
+/*
+ * @brief Get the 2D neighbors of a cell that are inside the grid without building a list
+ * @param const FVector& pos
+ * @return uint8 Bit i is set if the neighbor along Directions2D[i] is inside the grid
+ */
+uint8 ADungeonGenerator::GetNeighborMask2D(const FVector& pos) const
+{
+	constexpr int faceCount = UE_ARRAY_COUNT(Directions2D);
+	uint8 mask = 0;
+	for(int face = 0; face < faceCount; ++face)
+	{
+		if(layout.Grid.InBoundsIgnoreOffset(pos + Directions2D[face] * DungeonUnit))
+		{
+			mask |= 1 << face;
+		}
+	}
+	return mask;
+}
+
+/*
+ * @brief Check if a 2D neighbor of a cell holds stairs
+ * @param const FVector& cell
+ * @return bool
+ */
+bool ADungeonGenerator::IsNextToStairs(const FVector& cell) const
+{
+	constexpr int faceCount = UE_ARRAY_COUNT(Directions2D);
+	const uint8 mask = GetNeighborMask2D(cell);
+	for(int face = 0; face < faceCount; ++face)
+	{
+		if((mask & (1 << face)) && layout.Grid[cell + Directions2D[face] * DungeonUnit] == EStructureType::STAIRS)
+			return true;
+	}
+	return false;
+}
+
+/*
+ * @brief Get the position of a room used to match hallway paths
+ * @param const FDungeonRoomData& room
+ * @return FVector Anchor of the room
+ */
+FVector ADungeonGenerator::GetRoomAnchor(const FBox& roomBounds) const
+{
+	if(IsDungeonFloorBased)
+	{
+		return FVector(roomBounds.GetCenter().X, roomBounds.GetCenter().Y, roomBounds.Min.Z);
+	}
+
+	return roomBounds.GetCenter();
+}
+
+/*
+ * @brief Carve a routed path into the grid and add its hallways and stairs
+ * @param const TArray<FVector>& path
+ */
+void ADungeonGenerator::CarveHallwayPath(const TArray<FVector>& path)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(DungeonGen_CarveHallway);
+
+	// If the path is valid, set the structure type
+	if(path.Num() <= 0)
+		return;
+
+	// Cells carved by earlier paths already have their hallway piece
+	TArray<FVector, TInlineAllocator<64>> carvedCells;
+	
+	for(int i = 0; i<path.Num(); ++i)
+	{
+		FVector current = path[i];
+
+		// If the position on the grid is empty, set it to hallway
+		if(layout.Grid[current] == EStructureType::NONE)
+		{
+			layout.Grid[current] = EStructureType::HALLWAY;
+			carvedCells.Add(current);
+		}
+
+		if(i>0)
+		{
+			FVector pre = path[i-1];
+			FVector delta = current - pre;
+			
+			FVector spawnDirection = delta.GetSafeNormal2D();
+			float YawRotation = FMath::Atan2(spawnDirection.Y, spawnDirection.X) * (180.0f / PI);
+
+			// Set door positions of rooms
+			if(layout.Grid[current] != EStructureType::ROOM && layout.Grid[current] != EStructureType::NONE && layout.Grid[current] != EStructureType::STOP)
+			{
+				if(layout.Grid[pre] == EStructureType::ROOM)
+				{
+					AddRoomDoorPoint(pre, pre + delta * 0.5f);
+				}
+			}
+			else if(layout.Grid[current] == EStructureType::ROOM)
+			{
+				if(layout.Grid[pre] != EStructureType::ROOM && layout.Grid[pre] != EStructureType::NONE && layout.Grid[pre] != EStructureType::STOP)
+				{
+					AddRoomDoorPoint(current, pre + delta * 0.5f);
+				}
+			}
+			
+			if(delta.Z != 0)
+			{
+				int xDir = FMath::Clamp(FMath::RoundToInt(delta.X), -DungeonUnit, DungeonUnit);
+				int yDir = FMath::Clamp(FMath::RoundToInt(delta.Y), -DungeonUnit, DungeonUnit);
+				FVector verticalOffset = FVector(0, 0, delta.Z);
+				FVector horizontalOffset = FVector(xDir, yDir, 0);
+
+				layout.Grid[pre + horizontalOffset] = EStructureType::STAIRS;
+				layout.Grid[pre + horizontalOffset*2] = EStructureType::STAIRS;
+				layout.Grid[pre + horizontalOffset + verticalOffset] = EStructureType::STAIRS;
+				layout.Grid[pre + horizontalOffset*2 + verticalOffset] = EStructureType::STAIRS;
+
+				// Add stairs, they are spawned when the dungeon is materialized
+				if(StairsList.Num()>0 && (!DebugMode || (DebugMode && DebugWithModels)))
+				{
+					// Goes up
+					if(delta.Z > 0)
+					{
+						YawRotation += 90.f;
+						FRotator spawnRot = FRotator(0, YawRotation, 0);
+						layout.Stairs.Add(FDungeonPiece(EDungeonPrefabType::STAIRS, 0, FTransform(spawnRot, pre + horizontalOffset, FVector::OneVector)));
+					}
+					// Goes down
+					else if (delta.Z <0)
+					{
+						YawRotation -= 90.f;
+						FRotator spawnRot = FRotator(0, YawRotation, 0);
+						layout.Stairs.Add(FDungeonPiece(EDungeonPrefabType::STAIRS, 0, FTransform(spawnRot, pre + horizontalOffset*2 + verticalOffset, FVector::OneVector)));
 					}
 				}
+			}
+		}
+	}
+
+	// Add hallways, they are spawned when the dungeon is materialized, stairs may have replaced some carved cells
+	for(auto& pos : carvedCells)
+	{
+		if((!DebugMode || (DebugMode && DebugWithModels)))
+		{
+			if(layout.Grid[pos] == EStructureType::HALLWAY && HallwayList.Num()>0)
+			{
+				layout.HallwayCells.Add(pos);
+			}
+		}
+	}
+
+	layout.HallwayPaths.Add(path);
+}
+
+// ============ Generation State Machine ============
+
+/*
+ * @brief Reset the generator and start a new generation
+ * @param const FTransform& Starting point of the dungeon
+ * @param int the number of rooms to spawn
+ */
+void ADungeonGenerator::ResetGeneration(const FTransform& startingPoint, int roomSpawnSteps)
+{
+	// Reset variables, containers keep their memory between generations
+	layout.Reset(DungeonSize, DungeonUnit);
+	materializer.Reset();
+	
+	floorVertexMap.Reset();
+	floorStairVertexMap.Reset();
+	floorEdgeMap.Reset();
+	currentRoomGroupIndex = 0;
+	currentGroundFloorRoomCount = 0;
+	freeGenerationMode = false;
+	
+	selectedEdges.Reset();
+	roomVertices.Reset();
+	vertexGroupMap.Reset();
+	hallwayDoorLinks.Reset();
+	hallwayQueue.Reset();
+	hallwayCursor = 0;
+	failedHallwayCount = 0;
+	pathfinder.ResetStats(SlowPathQueryCount);
+	isCapturingPaths = false;
+
+	stageSeconds.Reset();
+	stageSeconds.SetNumZeroed(static_cast<int32>(EDungeonGenerationStage::DONE) + 1);
+
+	SET_DWORD_STAT(STAT_DungeonGenRoomsPlaced, 0);
+	SET_DWORD_STAT(STAT_DungeonGenRoomsRejected, 0);
+	SET_DWORD_STAT(STAT_DungeonGenEdgesRouted, 0);
+	SET_DWORD_STAT(STAT_DungeonGenEdgesFailed, 0);
+	SET_DWORD_STAT(STAT_DungeonGenNodesExpanded, 0);
+	SET_DWORD_STAT(STAT_DungeonGenActorsSpawned, 0);
+
+	// Prefab defaults are read here so the data stages can run off the game thread
+	CachePrefabInfo();
+	roomStream = MakeRandomStream(EDungeonGenerationStage::ROOMS);
+	isLayoutFromCache = false;
+
+	// Path captures are keyed like the cache, the prefab paths of the key are read here on the game thread
+	layoutCacheKey = UseLayoutCache || CaptureHallwaySearches ? ComputeLayoutCacheKey(startingPoint, roomSpawnSteps) : FDungeonLayoutCacheKey();
+
+	// Changed cells belong to the previous dungeon
+	dirtyCellChunks.Reset();
+	if(HasAuthority())
+	{
+		cellGeneration++;
+		ReplicatedCells.Chunks.Reset();
+		ReplicatedCells.MarkArrayDirty();
+	}
+
+	floorRoomCount.Reset();
+	currentFloorIndex = 0;
+	for(int i = 0; i<=currentFloorIndex; ++i)
+	{
+		floorRoomCount.Add(0);
+	}
+
+	generationStartingPoint = startingPoint;
+	generationRoomSteps = roomSpawnSteps;
+	generationRoomStep = 0;
+	IsGenerated = false;
+	
+	SetGenerationStage(EDungeonGenerationStage::ROOMS);
+}
+
+/*
+ * @brief Run one step of the current generation stage
+ * @param int maxPathExpansions Number of pathfinder expansions allowed in this step
+ * @param int maxSpawns Number of actors allowed to spawn in this step
+ * @return bool False once the generation is done
+ */
+bool ADungeonGenerator::StepGeneration(int maxPathExpansions, int maxSpawns)
+{
+	const EDungeonGenerationStage stepStage = currentStage;
+	const double stepStartTime = FPlatformTime::Seconds();
+	
+	switch(currentStage)
+	{
+	case EDungeonGenerationStage::ROOMS:
+		if(generationRoomStep == 0)
+		{
+			// Skip the rest of the rooms if the entrance can't be generated
+			if(!GenerateEntranceRoom(generationStartingPoint))
+				generationRoomStep = generationRoomSteps;
+		}
+		else if(generationRoomStep < generationRoomSteps)
+		{
+			GenerateNextRoom();
+		}
+		
+		generationRoomStep++;
+		if(generationRoomStep >= generationRoomSteps)
+		{
+			// Sort the rooms by floor
+			layout.RoomTable.BuildFloorRanges();
+			SetGenerationStage(EDungeonGenerationStage::TRIANGULATION);
+		}
+		break;
+	case EDungeonGenerationStage::TRIANGULATION:
+		Triangulate();
+		SetGenerationStage(EDungeonGenerationStage::HALLWAY_CANDIDATES);
+		break;
+	case EDungeonGenerationStage::HALLWAY_CANDIDATES:
+		FindPossibleHallways();
+		BeginHallways();
+		SetGenerationStage(EDungeonGenerationStage::HALLWAYS);
+		break;
+	case EDungeonGenerationStage::HALLWAYS:
+		if(!RouteNextHallway(maxPathExpansions))
+		{
+			if(DebugMode)
+			{
+				pathfinder.GetStats().LogSummary();
+			}
+			if(isCapturingPaths)
+			{
+				pathCapture.Save(FPaths::Combine(FDungeonPathCapture::GetCaptureDir(), FString::Printf(TEXT("%s_%d.dpcap"), *GetClass()->GetName(), Seed)));
+				isCapturingPaths = false;
+			}
+			SetGenerationStage(EDungeonGenerationStage::CLEANUP);
+		}
+		break;
+	case EDungeonGenerationStage::CLEANUP:
+		CleanUpDungeon();
+		SetGenerationStage(EDungeonGenerationStage::COURTYARD);
+		break;
+	case EDungeonGenerationStage::COURTYARD:
+		GenerateCourtyard();
+		SetGenerationStage(EDungeonGenerationStage::CEILINGS);
+		break;
+	case EDungeonGenerationStage::CEILINGS:
+		GenerateCeilings();
+		SetGenerationStage(EDungeonGenerationStage::WALLS);
+		break;
+	case EDungeonGenerationStage::WALLS:
+		GenerateWalls();
+		if(MergeCoplanarStructures)
+		{
+			// Ceilings span local X and Y, walls span local Y and Z
+			MergeCoplanarPieces(layout.Ceilings, 0, 1);
+			MergeCoplanarPieces(layout.Walls, 1, 2);
+		}
+		SET_MEMORY_STAT(STAT_DungeonGenLayoutMemory, layout.GetAllocatedSize());
+		SET_MEMORY_STAT(STAT_DungeonGenPathfinderMemory, pathfinder.GetAllocatedSize());
+		SetGenerationStage(EDungeonGenerationStage::MATERIALIZE);
+		break;
+	case EDungeonGenerationStage::MATERIALIZE:
+		// Actors are spawned over several steps, the closest to the entrance and players first
+		if(!materializer.IsMaterializing())
+		{
+			BeginMaterializeDungeon();
+		}
+		materializer.SpawnPending(maxSpawns);
+		
+		if(!materializer.IsMaterializing())
+		{
+			FinishGeneration();
+		}
+		break;
+	default:
+		return false;
+	}
+
+	stageSeconds[static_cast<int32>(stepStage)] += FPlatformTime::Seconds() - stepStartTime;
+	UpdateGenerationProgress();
+	return currentStage != EDungeonGenerationStage::DONE;
+}
+
+/*
+ * @brief Run generation steps until the frame budget is used up
+ * @param float budgetMs Milliseconds allowed in this frame
+ */
+void ADungeonGenerator::AdvanceGeneration(float budgetMs)
+{
+	const double startTime = FPlatformTime::Seconds();
+	const double budget = budgetMs * 0.001;
+	int spawnsLeft = MaxSpawnsPerFrame > 0 ? MaxSpawnsPerFrame : MAX_int32;
+
+	while(spawnsLeft > 0)
+	{
+		const int spawnedBefore = materializer.GetSpawnedCount();
+		if(!StepGeneration(PathExpansionsPerStep, FMath::Min(spawnsLeft, SpawnBatchSize)))
+			break;
+		
+		spawnsLeft -= materializer.GetSpawnedCount() - spawnedBefore;
+		if(FPlatformTime::Seconds() - startTime >= budget)
+			break;
+	}
+}
+
+/*
+ * @brief Set the current generation stage
+ * @param EDungeonGenerationStage stage
+ */
+void ADungeonGenerator::SetGenerationStage(EDungeonGenerationStage stage)
+{
+	currentStage = stage;
+	UpdateGenerationProgress();
+}
+
+/*
+ * @brief Update the generation progress based on the current stage
+ */
+void ADungeonGenerator::UpdateGenerationProgress()
+{
+	if(currentStage == EDungeonGenerationStage::IDLE)
+	{
+		PublishGenerationProgress(currentStage, 0.0f);
+		return;
+	}
+	
+	if(currentStage == EDungeonGenerationStage::DONE)
+	{
+		PublishGenerationProgress(currentStage, 1.0f);
+		return;
+	}
+
+	// Rooms and hallways report progress within the stage
+	float stageProgress = 0.0f;
+	if(currentStage == EDungeonGenerationStage::ROOMS)
+	{
+		stageProgress = static_cast<float>(generationRoomStep) / FMath::Max(generationRoomSteps, 1);
+	}
+	else if(currentStage == EDungeonGenerationStage::HALLWAYS)
+	{
+		stageProgress = static_cast<float>(hallwayCursor) / FMath::Max(hallwayQueue.Num(), 1);
+	}
+	else if(currentStage == EDungeonGenerationStage::MATERIALIZE)
+	{
+		const int spawned = materializer.GetSpawnedCount();
+		stageProgress = static_cast<float>(spawned) / FMath::Max(spawned + materializer.GetPendingSpawnCount(), 1);
+	}
+
+	const float stageCount = static_cast<int32>(EDungeonGenerationStage::DONE) - 1;
+	const float stageIndex = static_cast<int32>(currentStage) - 1;
+	PublishGenerationProgress(currentStage, FMath::Clamp((stageIndex + stageProgress) / stageCount, 0.0f, 1.0f));
+}
+
+/*
+ * @brief Expose the stage and progress to Blueprint
+ * @param EDungeonGenerationStage stage
+ * @param float progress
+ */
+void ADungeonGenerator::PublishGenerationProgress(EDungeonGenerationStage stage, float progress)
+{
+	// The background task can't write properties, Tick picks the values up instead
+	if(!IsInGameThread())
+	{
+		backgroundStage = stage;
+		backgroundProgress = progress;
+		return;
+	}
+	
+	GenerationStage = stage;
+	GenerationProgress = progress;
+}
+
+/*
+ * @brief Finish the generation
+ */
+void ADungeonGenerator::FinishGeneration()
+{
+	// Set the dungeon as generated
+	IsGenerated = true;
+	SetGenerationStage(EDungeonGenerationStage::DONE);
+
+	// The file is written on a worker, only the copy into the file buffer happens here
+	if(UseLayoutCache && !isLayoutFromCache)
+	{
+		if(layoutCacheSaveTask.IsValid())
+		{
+			layoutCacheSaveTask.Wait();
+		}
+		layoutCacheSaveTask = FDungeonLayoutCache::SaveAsync(layout, layoutCacheKey);
+	}
+
+	if(ReplicationMode == EDungeonReplicationMode::SEED)
+	{
+		const int32 checksum = static_cast<int32>(layout.ComputeChecksum());
+		if(HasAuthority())
+		{
+			FDungeonGenerationParams params;
+			params.Seed = Seed;
+			params.StartingPoint = generationStartingPoint;
+			params.RoomCount = generationRoomSteps;
+			params.Checksum = checksum;
+			params.Generation = cellGeneration;
+			ReplicatedGenerationParams = params;
+		}
+		else if(checksum != ReplicatedGenerationParams.Checksum)
+		{
+			UE_LOG(LogTemp, Error, TEXT("Dungeon layout differs from the server! Seed: %d"), Seed);
+		}
+	}
+
+	// Clients in actor replication mode get the whole grid, the chunks of seed mode can arrive before the layout is built
+	if(ReplicationMode == EDungeonReplicationMode::ACTORS && HasAuthority())
+	{
+		SnapshotCellChunks();
+	}
+	else if(!HasAuthority())
+	{
+		ApplyReplicatedCells();
+	}
+
+	// DEBUG
+	if(DebugMode)
+	{
+		DrawDebugGrid();
+	}
+
+	OnDungeonGenerated.Broadcast(true);
+}
+
+// ============ Layout Cache ============
+
+/*
+ * @brief Collect the parameters the layout depends on, the frame budgets, materialization, networking and debug options are left out
+ * @param const FTransform& startingPoint
+ * @param int roomCount
+ * @return FDungeonLayoutCacheKey Hash naming the cache file and the inputs compared on load
+ */
+FDungeonLayoutCacheKey ADungeonGenerator::ComputeLayoutCacheKey(const FTransform& startingPoint, int roomCount) const
+{
+	FDungeonLayoutCacheKey key;
+	FMemoryWriter writer(key.Inputs);
+
+	FVector startLocation = startingPoint.GetLocation();
+	double startYaw = startingPoint.Rotator().Yaw;
+	int32 rooms = roomCount;
+	int32 seed = Seed;
+	writer << startLocation << startYaw << rooms << seed;
+
+	// Basic
+	int32 unit = DungeonUnit;
+	FVector dungeonSize = DungeonSize;
+	FVector normalFloorSize = NormalFloorSize;
+	bool isRoomProcGen = IsRoomProcGen;
+	FVector maxRoomScale = MaxRoomScale;
+	FVector minRoomScale = MinRoomScale;
+	FVector defaultRoomSize = DefaultRoomSize;
+	float spawnOffset = SpawnOffset;
+	float loopProbability = LoopProbability;
+	writer << unit << dungeonSize << normalFloorSize << isRoomProcGen << maxRoomScale << minRoomScale << defaultRoomSize << spawnOffset << loopProbability;
+
+	// Advanced
+	bool isGroundFloorCourtyard = IsGroundFloorCourtyard;
+	int32 groundFloorIndex = GroundFloorIndex;
+	int32 minGroundFloorRoomCount = MinGroundFloorRoomCount;
+	int32 minRoomCount = MinRoomCount;
+	int32 maxDoorCount = MaxDoorCount;
+	int32 maxStairCaseCount = MaxStairCaseCount;
+	bool isDungeonFloorBased = IsDungeonFloorBased;
+	bool shouldGenerateBuilding = ShouldGenerateBuilding;
+	bool mergeCoplanarStructures = MergeCoplanarStructures;
+	bool triangulateRoomGroups = TriangulateRoomGroups;
+	float baseCost = BaseCost;
+	float roomExtraCost = RoomExtraCost;
+	float noneExtraCost = NoneExtraCost;
+	float changeFloorExtraCost = ChangeFloorExtraCost;
+	writer << isGroundFloorCourtyard << groundFloorIndex << minGroundFloorRoomCount << minRoomCount << maxDoorCount << maxStairCaseCount;
+	writer << isDungeonFloorBased << shouldGenerateBuilding << mergeCoplanarStructures << triangulateRoomGroups;
+	writer << baseCost << roomExtraCost << noneExtraCost << changeFloorExtraCost;
+
+	// The debug mode skips the courtyard and the ceilings, with models it also decides which stairs and hallway cells are kept
+	bool debugMode = DebugMode;
+	bool debugWithModels = DebugWithModels;
+	writer << debugMode << debugWithModels;
+
+	// Prefabs by path, their bounds and inner paths shape the layout
+	auto writeClass = [&writer](const UClass* prefab)
+	{
+		FString path = GetPathNameSafe(prefab);
+		writer << path;
+	};
+	auto writeClasses = [&writer, &writeClass](const auto& prefabs)
+	{
+		int32 count = prefabs.Num();
+		writer << count;
+		for(auto& prefab : prefabs)
+		{
+			writeClass(prefab.Get());
+		}
+	};
+	writeClass(EntranceRoom.Get());
+	writeClass(PathTileInPremadeRoom.Get());
+	writeClasses(RoomList);
+	writeClasses(PremadeRoomList);
+	writeClasses(WallList);
+	writeClasses(DoorList);
+	writeClasses(StairsList);
+	writeClasses(HallwayList);
+
+	key.Hash = HashCombine(GetTypeHash(FDungeonLayoutCache::Version), FCrc::MemCrc32(key.Inputs.GetData(), key.Inputs.Num()));
+	return key;
+}
+
+// ============ Headless Generation ============
+
+/*
+ * @brief Prepare a generation that only runs the data stages, the layout cache is skipped
+ * @param const FTransform& startingPoint Starting point of the dungeon
+ * @param int roomCount the number of rooms to spawn
+ * @param int seed
+ */
+void ADungeonGenerator::BeginHeadlessGeneration(const FTransform& startingPoint, int roomCount, int seed)
+{
+	StopBackgroundGeneration();
+	Seed = seed;
+	
+	// Prefab defaults are cached here, call it on the game thread
+	ResetGeneration(startingPoint, roomCount);
+}
+
+/*
+ * @brief Run the data stages of a generation started with BeginHeadlessGeneration, safe on a worker thread
+ * @return bool True if the layout is complete
+ */
+bool ADungeonGenerator::RunHeadlessGeneration()
+{
+	while(currentStage < EDungeonGenerationStage::MATERIALIZE && StepGeneration(PathExpansionsPerStep))
+	{
+	}
+
+	return currentStage == EDungeonGenerationStage::MATERIALIZE;
+}
+
+/*
+ * @brief Route the hallways of a capture on its layout, the results are recorded in the path capture of the generator
+ * @param const FDungeonPathCapture& capture
+ * @return bool False if the layout of the capture can't be read
+ */
+bool ADungeonGenerator::ReplayPathCapture(const FDungeonPathCapture& capture)
+{
+	StopBackgroundGeneration();
+	
+	if(!FDungeonLayoutCache::LoadFromMemory(layout, FDungeonLayoutCacheKey(capture.LayoutKey), capture.LayoutSnapshot.GetData(), capture.LayoutSnapshot.Num()))
+	{
+		UE_LOG(LogTemp, Error, TEXT("The layout of the path capture of seed %d is corrupted!"), capture.Seed);
+		return false;
+	}
+
+	Seed = capture.Seed;
+	DungeonUnit = capture.DungeonUnit;
+	DungeonSize = capture.DungeonSize;
+	IsDungeonFloorBased = capture.IsDungeonFloorBased;
+	BaseCost = capture.BaseCost;
+	RoomExtraCost = capture.RoomExtraCost;
+	NoneExtraCost = capture.NoneExtraCost;
+	ChangeFloorExtraCost = capture.ChangeFloorExtraCost;
+
+	pathfinder.Reset(DungeonSize, DungeonUnit);
+	pathfinder.ResetStats(SlowPathQueryCount);
+	hallwayQueue = capture.Requests;
+	hallwayCursor = 0;
+	hallwayDoorLinks.Reset();
+	failedHallwayCount = 0;
+
+	pathCapture = capture;
+	pathCapture.Results.Reset();
+	isCapturingPaths = true;
+	while(RouteNextHallway(MAX_int32))
+	{
+	}
+	isCapturingPaths = false;
+
+	return true;
+}
+
+/*
+ * @brief Get the searches of the last capture or replay
+ * @return const FDungeonPathCapture&
+ */
+const FDungeonPathCapture& ADungeonGenerator::GetPathCapture() const
+{
+	return pathCapture;
+}
+
+/*
+ * @brief Get the time spent in each stage of the last generation
+ * @return const TArray<double>& Seconds indexed by EDungeonGenerationStage
+ */
+const TArray<double>& ADungeonGenerator::GetStageSeconds() const
+{
+	return stageSeconds;
+}
+
+/*
+ * @brief Get the statistics of the hallway searches of the last generation
+ * @return const FPathfinderStats&
+ */
+const FPathfinderStats& ADungeonGenerator::GetPathfinderStats() const
+{
+	return pathfinder.GetStats();
+}
+
+/*
+ * @brief Get the memory used by the layout and the pathfinder of the last generation
+ * @return SIZE_T bytes
+ */
+SIZE_T ADungeonGenerator::GetGenerationMemory() const
+{
+	return layout.GetAllocatedSize() + pathfinder.GetAllocatedSize();
+}
+
+/*
+ * @brief Get the number of hallways the pathfinder couldn't route in the last generation
+ * @return int
+ */
+int ADungeonGenerator::GetFailedHallwayCount() const
+{
+	return failedHallwayCount;
+}
+
+// ============ Cell Replication ============
+
+/*
+ * @brief Encode every chunk of the generated grid into the replicated array, empty chunks are a single run
+ */
+void ADungeonGenerator::SnapshotCellChunks()
+{
+	const FIntVector cellCount = layout.Grid.GetCellCount();
+	const FIntVector chunkCount = FIntVector(
+		FMath::DivideAndRoundUp(cellCount.X, CellChunkSize),
+		FMath::DivideAndRoundUp(cellCount.Y, CellChunkSize),
+		FMath::DivideAndRoundUp(cellCount.Z, CellChunkSize)
+	);
+
+	ReplicatedCells.Chunks.Reserve(chunkCount.X * chunkCount.Y * chunkCount.Z);
+	for(int z = 0; z<chunkCount.Z; ++z)
+	{
+		for(int y = 0; y<chunkCount.Y; ++y)
+		{
+			for(int x = 0; x<chunkCount.X; ++x)
+			{
+				FDungeonCellChunk& chunk = ReplicatedCells.Chunks.AddDefaulted_GetRef();
+				chunk.Chunk = FIntVector(x, y, z);
+				chunk.Generation = cellGeneration;
+				chunk.Encode(layout.Grid, CellChunkSize);
+				ReplicatedCells.MarkItemDirty(chunk);
+			}
+		}
+	}
+}
+
+/*
+ * @brief Encode the changed chunks into the replicated array, in seed mode unchanged chunks are never sent
+ */
+void ADungeonGenerator::FlushDirtyCellChunks()
+{
+	for(auto& chunkCoord : dirtyCellChunks)
+	{
+		FDungeonCellChunk* chunk = ReplicatedCells.Chunks.FindByPredicate([&chunkCoord](const FDungeonCellChunk& item)
+		{
+			return item.Chunk == chunkCoord;
+		});
+		
+		if(!chunk)
+		{
+			chunk = &ReplicatedCells.Chunks.AddDefaulted_GetRef();
+			chunk->Chunk = chunkCoord;
+		}
+
+		chunk->Generation = cellGeneration;
+		chunk->Encode(layout.Grid, CellChunkSize);
+		ReplicatedCells.MarkItemDirty(*chunk);
+		OnCellsChanged.Broadcast(chunkCoord);
+	}
+	
+	dirtyCellChunks.Reset();
+}
+
+/*
+ * @brief Apply all replicated chunks to the freshly built layout
+ */
+void ADungeonGenerator::ApplyReplicatedCells()
+{
+	for(auto& chunk : ReplicatedCells.Chunks)
+	{
+		ApplyCellChunk(chunk);
+	}
+}
+
+// ============ Background Generation ============
+
+/*
+ * @brief Run the data stages on a worker thread, Tick takes over once they are done
+ */
+void ADungeonGenerator::LaunchBackgroundGeneration()
+{
+	generationCancelToken = MakeShared<std::atomic<bool>, ESPMode::ThreadSafe>(false);
+	backgroundStage = currentStage;
+	backgroundProgress = GenerationProgress;
+
+	TSharedPtr<std::atomic<bool>, ESPMode::ThreadSafe> cancelToken = generationCancelToken;
+	generationTask = UE::Tasks::Launch(UE_SOURCE_LOCATION, [this, cancelToken]()
+	{
+		// Stop before the first stage that spawns actors
+		while(!*cancelToken && currentStage < EDungeonGenerationStage::MATERIALIZE && StepGeneration(PathExpansionsPerStep))
+		{
+		}
+	});
+}
+
+/*
+ * @brief Cancel the background task and wait for it to stop
+ */
+void ADungeonGenerator::StopBackgroundGeneration()
+{
+	if(!generationTask.IsValid())
+		return;
+
+	*generationCancelToken = true;
+	generationTask.Wait();
+	generationTask = UE::Tasks::FTask();
+	SetGenerationStage(EDungeonGenerationStage::IDLE);
+}
+
+/*
+ * @brief Check on the background task
+ * @return bool True if the game thread can continue the generation
+ */
+bool ADungeonGenerator::PollBackgroundGeneration()
+{
+	if(!generationTask.IsValid())
+		return true;
+
+	if(!generationTask.IsCompleted())
+	{
+		GenerationStage = backgroundStage;
+		GenerationProgress = backgroundProgress;
+		return false;
+	}
+	
+	generationTask = UE::Tasks::FTask();
+
+	if(*generationCancelToken)
+	{
+		SetGenerationStage(EDungeonGenerationStage::IDLE);
+		OnDungeonGenerated.Broadcast(false);
+		return false;
+	}
+
+	// Publish the final state of the worker from the game thread
+	UpdateGenerationProgress();
+	return true;
+}
 
-				// Spawn hallways
-				FVector prePos = path[0];
-				for(auto& pos : path)
+/*
+ * @brief Loop through the grid and draw the structure type
+ */
+void ADungeonGenerator::DrawDebugGrid()
+{
+	for(int z = 0; z<DungeonSize.Z; z+=DungeonUnit)
+	{
+		for(int y = 0; y<DungeonSize.Y; y+=DungeonUnit)
+		{
+			for(int x = 0; x<DungeonSize.X; x+=DungeonUnit)
+			{
+				FVector pos = FVector(x, y, z);
+				switch(layout.Grid[pos])
 				{
-					FVector curPos = pos;
-					if((!DebugMode || (DebugMode && DebugWithModels)))
-					{
-						if(grid[curPos] == EStructureType::HALLWAY && HallwayList.Num()>0)
-						{
-							FTransform transform = FTransform(FRotator::ZeroRotator, pos, FVector::OneVector);
-							AMainRoom* spawnedHallway = SpawnStructure(transform, HallwayList[0], false);
-							hallwaysVertices.Add(pos);
-							if(!spawnedHallway)
-								continue;
-							
-							spawnedHallway->InitInfo(transform, FVector::OneVector, spawnedHallway->GetComponentsBoundingBox());
-						}
-					}
-					
-					if(DebugMode)
-					{
-						DrawDebugLine(GetWorld(), prePos, curPos, FColor::Red, true, -1, 0, 0.15f);
-						prePos = curPos;
-					}
+				case EStructureType::STOP:
+					DrawDebugSphere(GetWorld(), pos, 0.25*DungeonUnit, 8, FColor::White, true, -1);
+						break;
+				case EStructureType::ROOM:
+					if(DebugType == EDungenDebugType::ROOM|| DebugType == EDungenDebugType::ALL)
+						DrawDebugSphere(GetWorld(), pos, 0.25*DungeonUnit, 8, FColor::Blue, true, -1);
+					break;
+				case EStructureType::HALLWAY:
+					if(DebugType == EDungenDebugType::HALLWAY|| DebugType == EDungenDebugType::ALL)
+						DrawDebugSphere(GetWorld(), pos, 0.25*DungeonUnit, 8, FColor::Green, true, -1);
+					break;
+				case EStructureType::STAIRS:
+					if(DebugType == EDungenDebugType::STAIRS|| DebugType == EDungenDebugType::ALL)
+						DrawDebugSphere(GetWorld(), pos, 0.25*DungeonUnit, 8, FColor::Cyan, true, -1);
+					break;
+				default:
+					break;
 				}
 			}
-		}	
+		}
 	}
 }
 
 /*
- * @brief Clean up the dungeon
+ * @brief Clean up the dungeon, rooms that can't be reached from the entrance or have no hallway are never spawned
  */
 void ADungeonGenerator::CleanUpDungeon()
 {
-	if(DebugMode)
-		return;
-	
-	if(IsRoomProcGen)
+	TRACE_CPUPROFILER_EVENT_SCOPE(DungeonGen_CleanUp);
+
+	TBitArray<> removedRooms(false, layout.Rooms.Num());
+	if(!DebugMode)
 	{
-		for(auto& roomGroup : spawnedRooms)
+		const TBitArray<> reachableGroups = FindReachableRoomGroups();
+		
+		if(IsRoomProcGen)
+		{
+			for(int groupIndex = 0; groupIndex < layout.RoomGroups.Num(); ++groupIndex)
+			{
+				TArray<int>& roomGroup = layout.RoomGroups[groupIndex];
+				const bool reachable = reachableGroups[groupIndex];
+				
+				// Rooms of a group are next to each other, a hallway to one of them reaches the whole group
+				if(reachable && TriangulateRoomGroups && roomGroup.ContainsByPredicate([this](int roomIndex) { return layout.Rooms[roomIndex].IsConnectedToHallway; }))
+					continue;
+
+				for(const int roomIndex : roomGroup)
+				{
+					if(!reachable || !layout.Rooms[roomIndex].IsConnectedToHallway)
+					{
+						removedRooms[roomIndex] = true;
+					}
+				}
+				roomGroup.RemoveAll([&removedRooms](int roomIndex) { return removedRooms[roomIndex]; });
+			}
+		}
+		else
 		{
-			TArray<AMainRoom*> toBeReomved;
-			for(auto& room : roomGroup)
+			TArray<int> toBeReomved;
+			for(auto& roomGroup: layout.PremadeRooms)
 			{
-				if(!room->IsConnectedToHallway)
+				bool connected = false;
+				for(const int innerPath: roomGroup.Value)
+				{
+					const int groupIndex = layout.RoomTable.Groups[innerPath];
+					if(layout.Rooms[innerPath].IsConnectedToHallway && reachableGroups[groupIndex])
+					{
+						connected = true;
+						break;
+					}
+				}
+
+				if(!connected)
 				{
-					toBeReomved.Add(room);
+					toBeReomved.Add(roomGroup.Key);
 				}
 			}
 
-			for(auto& room : toBeReomved)
+			for(const int premadeIndex : toBeReomved)
 			{
-				if(ReplicatedRoomLocations.Contains(room->Transform.GetLocation()))
+				removedRooms[premadeIndex] = true;
+
+				// Remove the inner paths from their room group
+				for(const int innerPath : layout.PremadeRooms[premadeIndex])
 				{
-					ReplicatedRoomLocations.Remove(room->Transform.GetLocation());
+					removedRooms[innerPath] = true;
+					layout.RoomGroups[layout.RoomTable.Groups[innerPath]].Remove(innerPath);
 				}
+				
+				layout.PremadeRooms.Remove(premadeIndex);
+			}
+		}
+	}
+
+	// Spawn points are built once from the rooms that are left
+	layout.RoomLocations.Reset();
+	for(int roomIndex = 0; roomIndex < layout.Rooms.Num(); ++roomIndex)
+	{
+		const FDungeonRoomData& room = layout.Rooms[roomIndex];
+		if(!removedRooms[roomIndex] && (room.PrefabType == EDungeonPrefabType::ROOM || room.PrefabType == EDungeonPrefabType::PREMADE))
+		{
+			layout.RoomLocations.Add(room.Transform.GetLocation());
+		}
+	}
+}
+
+/*
+ * @brief Find the room groups a player can walk to from the entrance through the routed hallways
+ * Groups are linked to the hallways they have doors on, hallways sharing or bordering a cell are linked to each other
+ * @return TBitArray<> Indexed by room group
+ */
+TBitArray<> ADungeonGenerator::FindReachableRoomGroups() const
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(DungeonGen_Reachability);
+
+	if(layout.Rooms.IsEmpty())
+		return TBitArray<>(false, layout.RoomGroups.Num());
+
+	// Nodes are the groups followed by the hallways
+	const int groupCount = layout.RoomGroups.Num();
+	const int nodeCount = groupCount + layout.HallwayPaths.Num();
+	TArray<TArray<int>> links;
+	links.SetNum(nodeCount);
+	auto link = [&links](int a, int b)
+	{
+		links[a].AddUnique(b);
+		links[b].AddUnique(a);
+	};
+
+	for(const FIntPoint& doorLink : hallwayDoorLinks)
+	{
+		const int groupIndex = layout.RoomTable.Groups[doorLink.X];
+		if(groupIndex != INDEX_NONE)
+		{
+			link(groupIndex, groupCount + doorLink.Y);
+		}
+	}
+
+	// The entrance isn't in the grid so it has no doors, its hallways start at its anchor
+	// Path points are compared on the grid, the anchor and the path ends come from different float math
+	const FVector entranceAnchor = GetRoomAnchor(layout.RoomTable.Bounds[0]).GridSnap(DungeonUnit);
+	int rootGroup = layout.RoomTable.Groups[0];
+	bool hasEntranceHallway = false;
+	TMap<FVector, int> cellPaths;
+	for(int pathIndex = 0; pathIndex < layout.HallwayPaths.Num(); ++pathIndex)
+	{
+		const TArray<FVector>& path = layout.HallwayPaths[pathIndex];
+		if(path[0].GridSnap(DungeonUnit) == entranceAnchor || path.Last().GridSnap(DungeonUnit) == entranceAnchor)
+		{
+			link(rootGroup, groupCount + pathIndex);
+			hasEntranceHallway = true;
+		}
 
-				roomGroup.Remove(room);
-				room->Destroy();
+		for(const FVector& point : path)
+		{
+			const FVector cell = point.GridSnap(DungeonUnit);
+			const int* otherPath = cellPaths.Find(cell);
+			if(!otherPath)
+			{
+				cellPaths.Add(cell, pathIndex);
+			}
+			else if(*otherPath != pathIndex)
+			{
+				link(groupCount + *otherPath, groupCount + pathIndex);
 			}
 		}
 	}
-	else
+
+	// Hallways routed next to each other are open to each other, the walls only go up towards empty cells
+	for(const TPair<FVector, int>& cellPath : cellPaths)
 	{
-		TArray<AMainRoom*> toBeReomved;
-		for(auto& roomGroup: cleanupMap)
+		for(const FVector& direction : Directions2D)
 		{
-			bool connected = false;
-			for(auto& innerPath: roomGroup.Value)
+			const FVector neighbor = cellPath.Key + direction * DungeonUnit;
+			if(!layout.Grid.InBoundsIgnoreOffset(neighbor))
+				continue;
+
+			const EStructureType neighborType = layout.Grid[neighbor];
+			if(neighborType != EStructureType::HALLWAY && neighborType != EStructureType::STAIRS)
+				continue;
+
+			const int* neighborPath = cellPaths.Find(neighbor);
+			if(neighborPath && *neighborPath != cellPath.Value)
 			{
-				if(innerPath->IsConnectedToHallway)
-				{
-					connected = true;
-					break;
-				}
+				link(groupCount + *neighborPath, groupCount + cellPath.Value);
 			}
+		}
+	}
 
-			if(!connected)
+	// Floor based dungeons don't route hallways to the entrance, it opens into the closest connected room
+	if(!hasEntranceHallway)
+	{
+		double minDistance = MAX_dbl;
+		for(int roomIndex = 1; roomIndex < layout.Rooms.Num(); ++roomIndex)
+		{
+			const double distance = FVector::DistSquared(layout.Rooms[roomIndex].Transform.GetLocation(), layout.Rooms[0].Transform.GetLocation());
+			if(layout.Rooms[roomIndex].IsConnectedToHallway && layout.RoomTable.Groups[roomIndex] != INDEX_NONE && distance < minDistance)
 			{
-				toBeReomved.Add(roomGroup.Key);
-				for(auto& innerPath: roomGroup.Value)
-				{
-					toBeReomved.Add(innerPath);
-				}
+				minDistance = distance;
+				rootGroup = layout.RoomTable.Groups[roomIndex];
+			}
+		}
+	}
+
+	TBitArray<> visited(false, nodeCount);
+	TArray<int> open;
+	if(rootGroup != INDEX_NONE && rootGroup < groupCount)
+	{
+		visited[rootGroup] = true;
+		open.Add(rootGroup);
+	}
+	while(!open.IsEmpty())
+	{
+		const int node = open.Pop(EAllowShrinking::No);
+		for(const int next : links[node])
+		{
+			if(!visited[next])
+			{
+				visited[next] = true;
+				open.Add(next);
+			}
+		}
+	}
+
+	TBitArray<> reachableGroups(false, groupCount);
+	for(int groupIndex = 0; groupIndex < groupCount; ++groupIndex)
+	{
+		reachableGroups[groupIndex] = visited[groupIndex];
+	}
+	return reachableGroups;
+}
+
+/*
+ * @brief Spawn the actors of the generated dungeon
+ */
+void ADungeonGenerator::MaterializeDungeon()
+{
+	BeginMaterializeDungeon();
+	materializer.SpawnPending(MAX_int32);
+}
+
+/*
+ * @brief Queue the actors of the generated dungeon, they are spawned by the materializer
+ */
+void ADungeonGenerator::BeginMaterializeDungeon()
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(DungeonGen_QueueActors);
+
+	materializer.BeginMaterialize(layout, GetSpawnPriorityOrigins());
+
+	// The replicated list is only touched on the game thread
+	ReplicatedRoomLocations = layout.RoomLocations;
+
+	// DEBUG LINES
+	if(DebugMode)
+	{
+		for(auto& path : layout.HallwayPaths)
+		{
+			for(int i = 1; i<path.Num(); ++i)
+			{
+				DrawDebugLine(GetWorld(), path[i-1], path[i], FColor::Red, true, -1, 0, 0.15f);
+			}
+		}
+	}
+}
+
+/*
+ * @brief Get the class of a prefab referenced by the layout
+ * @param EDungeonPrefabType prefabType List the prefab is in
+ * @param int prefabIndex Index in the list
+ * @return TSubclassOf<AMainRoom> The class, null if the prefab doesn't exist
+ */
+TSubclassOf<AMainRoom> ADungeonGenerator::GetPrefabClass(EDungeonPrefabType prefabType, int prefabIndex) const
+{
+	switch(prefabType)
+	{
+	case EDungeonPrefabType::ENTRANCE:
+		return EntranceRoom;
+	case EDungeonPrefabType::ROOM:
+		return RoomList.IsValidIndex(prefabIndex) ? RoomList[prefabIndex] : TSubclassOf<AMainRoom>();
+	case EDungeonPrefabType::PREMADE:
+		return PremadeRoomList.IsValidIndex(prefabIndex) ? TSubclassOf<AMainRoom>(PremadeRoomList[prefabIndex]) : TSubclassOf<AMainRoom>();
+	case EDungeonPrefabType::PREMADE_PATH:
+		return PathTileInPremadeRoom;
+	case EDungeonPrefabType::HALLWAY:
+		return HallwayList.IsValidIndex(prefabIndex) ? TSubclassOf<AMainRoom>(HallwayList[prefabIndex]) : TSubclassOf<AMainRoom>();
+	case EDungeonPrefabType::STAIRS:
+		return StairsList.IsValidIndex(prefabIndex) ? TSubclassOf<AMainRoom>(StairsList[prefabIndex]) : TSubclassOf<AMainRoom>();
+	case EDungeonPrefabType::WALL:
+		return WallList.IsValidIndex(prefabIndex) ? WallList[prefabIndex] : TSubclassOf<AMainRoom>();
+	default:
+		return TSubclassOf<AMainRoom>();
+	}
+}
+
+/*
+ * @brief Get the locations the actors closest to are spawned first
+ * @return TArray<FVector> The entrance and the pawns of all players
+ */
+TArray<FVector> ADungeonGenerator::GetSpawnPriorityOrigins() const
+{
+	TArray<FVector> origins;
+	origins.Add(layout.Rooms.IsEmpty() ? generationStartingPoint.GetLocation() : layout.Rooms[0].Transform.GetLocation());
+
+	for(FConstPlayerControllerIterator it = GetWorld()->GetPlayerControllerIterator(); it; ++it)
+	{
+		const APlayerController* playerController = it->Get();
+		if(playerController && playerController->GetPawn())
+		{
+			origins.Add(playerController->GetPawn()->GetActorLocation());
+		}
+	}
+
+	return origins;
+}
+
+/*
+ * @brief Get the actor of a room
+ * @param int roomIndex Index in the room table of the layout
+ * @return AMainRoom* The room, null if it wasn't spawned yet
+ */
+AMainRoom* ADungeonGenerator::GetRoomActor(int roomIndex) const
+{
+	return materializer.GetRoomActor(roomIndex);
+}
+
+/*
+ * @brief Check if the actor of a room is still waiting to be spawned
+ * @param int roomIndex Index in the room table of the layout
+ * @return bool True while the room is queued
+ */
+bool ADungeonGenerator::IsRoomActorPending(int roomIndex) const
+{
+	return materializer.IsRoomPending(roomIndex);
+}
+
+/*
+ * @brief Get the generated dungeon
+ * @return const FDungeonLayout& The layout of the last generation
+ */
+const FDungeonLayout& ADungeonGenerator::GetLayout() const
+{
+	return layout;
+}
+
+/*
+ * @brief Merge identical pieces on the same plane into maximal rectangles
+ * Each rectangle becomes one piece scaled over all of its cells, duplicated pieces are dropped.
+ * @param TArray<FDungeonPiece>& pieces Pieces to merge, replaced by the merged pieces
+ * @param int axisA First local axis the pieces span
+ * @param int axisB Second local axis the pieces span
+ */
+void ADungeonGenerator::MergeCoplanarPieces(TArray<FDungeonPiece>& pieces, int axisA, int axisB)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(DungeonGen_MergeCoplanar);
+
+	const int normalAxis = 3 - axisA - axisB;
+
+	// prefab, yaw and plane of the pieces -> cells on the plane -> piece index
+	using FMergeGroupKey = TTuple<uint8, int, int, int>;
+	TMap<FMergeGroupKey, TMap<FIntPoint, int>> groups;
+
+	for(int i = 0; i<pieces.Num(); ++i)
+	{
+		const FDungeonPiece& piece = pieces[i];
+		const int yaw = FMath::RoundToInt(FRotator::NormalizeAxis(piece.Transform.Rotator().Yaw));
+		const FVector localPos = FRotator(0, yaw, 0).UnrotateVector(piece.Transform.GetLocation());
+		const FMergeGroupKey key(static_cast<uint8>(piece.PrefabType), piece.PrefabIndex, yaw, FMath::RoundToInt(localPos[normalAxis]));
+		const FIntPoint cell(FMath::RoundToInt(localPos[axisA] / DungeonUnit), FMath::RoundToInt(localPos[axisB] / DungeonUnit));
+		
+		groups.FindOrAdd(key).FindOrAdd(cell, i);
+	}
+
+	TArray<FDungeonPiece> mergedPieces;
+	mergedPieces.Reserve(groups.Num());
+	
+	for(auto& group : groups)
+	{
+		TMap<FIntPoint, int>& cells = group.Value;
+		const FRotator rotation = FRotator(0, group.Key.Get<2>(), 0);
+		const FDungeonPiece& firstPiece = pieces[cells.CreateConstIterator().Value()];
+		
+		// Pieces are stretched from the min corner of their bounds, flat prefabs can't be stretched
+		const FBox prefabBounds = GetPrefabInfo(GetPrefabClass(firstPiece.PrefabType, firstPiece.PrefabIndex)).MeshBounds;
+		const FVector prefabSize = prefabBounds.GetSize();
+		if(!prefabBounds.IsValid || prefabSize[axisA] < KINDA_SMALL_NUMBER || prefabSize[axisB] < KINDA_SMALL_NUMBER)
+		{
+			for(auto& cell : cells)
+			{
+				mergedPieces.Add(pieces[cell.Value]);
 			}
+			continue;
 		}
 
-		for(auto& room : toBeReomved)
+		// Row by row so the rectangles are the same every run
+		TArray<FIntPoint> sortedCells;
+		cells.GenerateKeyArray(sortedCells);
+		sortedCells.Sort([](const FIntPoint& a, const FIntPoint& b)
+		{
+			return a.Y != b.Y ? a.Y < b.Y : a.X < b.X;
+		});
+
+		for(auto& start : sortedCells)
 		{
-			// Remove the main room spawn points from the replicated list
-			if(ReplicatedRoomLocations.Contains(room->Transform.GetLocation()))
+			if(!cells.Contains(start))
+				continue;
+
+			// Grow along the first axis, then add rows while the whole row is free
+			int width = 1;
+			while(cells.Contains(FIntPoint(start.X + width, start.Y)))
 			{
-				ReplicatedRoomLocations.Remove(room->Transform.GetLocation());
+				width++;
 			}
 
-			// Remove the room instance from the spawned rooms list
-			for(auto& roomGroup: spawnedRooms)
+			int height = 1;
+			bool isRowFree = true;
+			while(isRowFree)
 			{
-				if(roomGroup.Contains(room))
+				for(int x = 0; x<width; ++x)
 				{
-					roomGroup.Remove(room);
-					break;
+					if(!cells.Contains(FIntPoint(start.X + x, start.Y + height)))
+					{
+						isRowFree = false;
+						break;
+					}
+				}
+				
+				if(isRowFree)
+					height++;
+			}
+
+			FDungeonPiece mergedPiece = pieces[cells[start]];
+			mergedPiece.Bounds = FBox(ForceInit);
+			for(int y = 0; y<height; ++y)
+			{
+				for(int x = 0; x<width; ++x)
+				{
+					int pieceIndex = INDEX_NONE;
+					cells.RemoveAndCopyValue(FIntPoint(start.X + x, start.Y + y), pieceIndex);
+					if(pieces[pieceIndex].Bounds.IsValid)
+					{
+						mergedPiece.Bounds += pieces[pieceIndex].Bounds;
+					}
 				}
-				room->Destroy();
 			}
+
+			if(width > 1 || height > 1)
+			{
+				FVector scale = FVector::OneVector;
+				scale[axisA] = ((width - 1) * DungeonUnit + prefabSize[axisA]) / prefabSize[axisA];
+				scale[axisB] = ((height - 1) * DungeonUnit + prefabSize[axisB]) / prefabSize[axisB];
+
+				// Keep the min corner of the bounds where it was for the first cell
+				FVector localPos = rotation.UnrotateVector(mergedPiece.Transform.GetLocation());
+				localPos[axisA] += (1.0f - scale[axisA]) * prefabBounds.Min[axisA];
+				localPos[axisB] += (1.0f - scale[axisB]) * prefabBounds.Min[axisB];
+				
+				mergedPiece.Transform = FTransform(rotation, rotation.RotateVector(localPos), scale);
+			}
+			
+			mergedPieces.Add(mergedPiece);
 		}
 	}
+
+	pieces = MoveTemp(mergedPieces);
+}
+
+/*
+ * @brief Cache the default data of all prefabs so the generation doesn't need the CDOs
+ */
+void ADungeonGenerator::CachePrefabInfo()
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(DungeonGen_CachePrefabs);
+
+	TArray<TSubclassOf<AMainRoom>> prefabs;
+	prefabs.Add(EntranceRoom);
+	prefabs.Add(PathTileInPremadeRoom);
+	prefabs.Append(RoomList);
+	prefabs.Append(WallList);
+	for(auto& premade : PremadeRoomList)
+	{
+		prefabs.Add(premade);
+	}
+
+	for(auto& prefab : prefabs)
+	{
+		if(!IsValid(prefab.Get()) || prefabInfoMap.Contains(prefab.Get()))
+			continue;
+
+		const AMainRoom* defaultRoom = prefab->GetDefaultObject<AMainRoom>();
+		FDungeonPrefabInfo info;
+		info.Bounds = defaultRoom->Bounds;
+		info.ComponentsBounds = defaultRoom->GetComponentsBoundingBox();
+		info.InnerPaths = defaultRoom->InnerPaths;
+
+		// Components aren't registered on the CDO and Blueprint components only exist on the class, read the mesh templates instead
+		AActor::ForEachComponentOfActorClassDefault(prefab, UStaticMeshComponent::StaticClass(), [&info](const UActorComponent* component)
+		{
+			const UStaticMeshComponent* meshComponent = Cast<UStaticMeshComponent>(component);
+			if(meshComponent && meshComponent->GetStaticMesh())
+			{
+				info.MeshBounds += meshComponent->GetStaticMesh()->GetBoundingBox().TransformBy(meshComponent->GetRelativeTransform());
+			}
+			return true;
+		});
+		prefabInfoMap.Add(prefab.Get(), info);
+	}
+}
+
+/*
+ * @brief Get the cached default data of a prefab
+ * @param TSubclassOf<AMainRoom> prefab
+ * @return const FDungeonPrefabInfo& Default data of the prefab
+ */
+const FDungeonPrefabInfo& ADungeonGenerator::GetPrefabInfo(TSubclassOf<AMainRoom> prefab)
+{
+	if(const FDungeonPrefabInfo* info = prefabInfoMap.Find(prefab.Get()))
+		return *info;
+
+	// Prefabs can only be cached on the game thread
+	if(IsInGameThread())
+	{
+		CachePrefabInfo();
+		if(const FDungeonPrefabInfo* info = prefabInfoMap.Find(prefab.Get()))
+			return *info;
+	}
+
+	UE_LOG(LogTemp, Error, TEXT("Prefab is not cached or null!"));
+	static const FDungeonPrefabInfo emptyInfo;
+	return emptyInfo;
 }
 
 /*
@@ -1803,19 +3095,19 @@ DungeonPathInfo ADungeonGenerator::CostFunction(const DungeonNode& a, const Dung
 	{
 		info.Cost = FVector::Distance(b.Position, endPos);
 
-		if(grid[b.Position] == EStructureType::STAIRS || grid[b.Position] == EStructureType::STOP)
+		if(layout.Grid[b.Position] == EStructureType::STAIRS || layout.Grid[b.Position] == EStructureType::STOP)
 			return info;
-		else if(grid[b.Position] == EStructureType::ROOM)
+		else if(layout.Grid[b.Position] == EStructureType::ROOM)
 			info.Cost += RoomExtraCost;
-		else if(grid[b.Position] == EStructureType::NONE)
+		else if(layout.Grid[b.Position] == EStructureType::NONE)
 			info.Cost += NoneExtraCost;
 
 		info.Traversable = true;
 	}
 	else // Stairs path
 	{
-		if((grid[a.Position] != EStructureType::NONE && grid[a.Position] != EStructureType::HALLWAY)
-			|| (grid[b.Position] != EStructureType::NONE && grid[b.Position] != EStructureType::HALLWAY))
+		if((layout.Grid[a.Position] != EStructureType::NONE && layout.Grid[a.Position] != EStructureType::HALLWAY)
+			|| (layout.Grid[b.Position] != EStructureType::NONE && layout.Grid[b.Position] != EStructureType::HALLWAY))
 		{
 			return info;
 		}
@@ -1829,18 +3121,18 @@ DungeonPathInfo ADungeonGenerator::CostFunction(const DungeonNode& a, const Dung
 		FVector horizontalOffset = FVector(xDir, yDir, 0);
 
 		// Check if in bounds
-		if(!grid.InBounds(a.Position + verticalOffset)
-			|| !grid.InBounds(a.Position + horizontalOffset)
-			|| !grid.InBounds(a.Position + horizontalOffset + verticalOffset))
+		if(!layout.Grid.InBounds(a.Position + verticalOffset)
+			|| !layout.Grid.InBounds(a.Position + horizontalOffset)
+			|| !layout.Grid.InBounds(a.Position + horizontalOffset + verticalOffset))
 		{
 			return info;
 		}
 
 		// Check if the positions are valid for creating stairs
-		if(grid[a.Position + horizontalOffset] != EStructureType::NONE
-			|| grid[a.Position + horizontalOffset*2] != EStructureType::NONE
-			|| grid[a.Position + horizontalOffset + verticalOffset] != EStructureType::NONE
-			|| grid[a.Position + horizontalOffset*2 + verticalOffset] != EStructureType::NONE)
+		if(layout.Grid[a.Position + horizontalOffset] != EStructureType::NONE
+			|| layout.Grid[a.Position + horizontalOffset*2] != EStructureType::NONE
+			|| layout.Grid[a.Position + horizontalOffset + verticalOffset] != EStructureType::NONE
+			|| layout.Grid[a.Position + horizontalOffset*2 + verticalOffset] != EStructureType::NONE)
 		{
 			return info;
 		}
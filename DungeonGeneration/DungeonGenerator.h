@@ -5,8 +5,15 @@
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
 #include "CompGeom/Delaunay3.h"
+#include "Tasks/Task.h"
+#include <atomic>
 
 #include "Grid3D.h"
+#include "DungeonLayout.h"
+#include "DungeonMaterializer.h"
+#include "DungeonCellReplication.h"
+#include "DungeonLayoutCache.h"
+#include "DungeonGraph.h"
 #include "NetworkingPrototype/Structures/MainRoom.h"
 #include "NetworkingPrototype/Structures/Hallway.h"
 #include "NetworkingPrototype/Structures/Stairs.h"
@@ -14,6 +21,7 @@
 #include "NavigationSystem.h"
 #include "BasicDoor.h"
 #include "DungeonPathfinder3D.h"
+#include "DungeonPathCapture.h"
 #include "DungeonGenerator.generated.h"
 
 UENUM(BlueprintType)
@@ -27,20 +35,87 @@ enum class EDungenDebugType : uint8
 };
 
 UENUM(BlueprintType)
-enum class EStructureType : uint8
+enum class EDungeonGenerationMode : uint8
 {
-	NONE	UMETA(DisplayName="None"),
-	STOP	UMETA(DisplayName="Stop"),
-	ROOM	UMETA(DisplayName="Room"),
-	GROUND	UMETA(DisplayName="Ground"),
-	HALLWAY	UMETA(DisplayName="Hallway"),
-	STAIRS	UMETA(DisplayName="Stairs")
+	SYNCHRONOUS	UMETA(DisplayName="Synchronous"),
+	TIME_SLICED	UMETA(DisplayName="Time Sliced"),
+	ASYNC		UMETA(DisplayName="Background Thread")
+};
+
+UENUM(BlueprintType)
+enum class EDungeonMaterializeMode : uint8
+{
+	ACTORS		UMETA(DisplayName="Actors"),
+	INSTANCED	UMETA(DisplayName="Instanced Meshes")
+};
+
+UENUM(BlueprintType)
+enum class EDungeonGenerationStage : uint8
+{
+	IDLE				UMETA(DisplayName="Idle"),
+	ROOMS				UMETA(DisplayName="Rooms"),
+	TRIANGULATION		UMETA(DisplayName="Triangulation"),
+	HALLWAY_CANDIDATES	UMETA(DisplayName="Hallway Candidates"),
+	HALLWAYS			UMETA(DisplayName="Hallways"),
+	CLEANUP				UMETA(DisplayName="Clean Up"),
+	COURTYARD			UMETA(DisplayName="Courtyard"),
+	CEILINGS			UMETA(DisplayName="Ceilings"),
+	WALLS				UMETA(DisplayName="Walls"),
+	MATERIALIZE			UMETA(DisplayName="Materialize"),
+	DONE				UMETA(DisplayName="Done")
+};
+
+UENUM(BlueprintType)
+enum class EDungeonReplicationMode : uint8
+{
+	ACTORS	UMETA(DisplayName="Replicated Actors"),
+	SEED	UMETA(DisplayName="Seed And Parameters")
+};
+
+// Everything a client needs to rebuild the dungeon of the server
+USTRUCT(BlueprintType)
+struct FDungeonGenerationParams
+{
+	GENERATED_BODY()
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	int32 Seed = 0;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	FTransform StartingPoint = FTransform::Identity;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	int32 RoomCount = 0;
+
+	// Checksum of the layout generated by the server
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	int32 Checksum = 0;
+
+	// Generation counted by the server, the replicated cell chunks of this layout carry the same number
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	int32 Generation = 0;
 };
 
+// Default data of a prefab, cached so generation doesn't touch the CDOs
+struct FDungeonPrefabInfo
+{
+	FBox Bounds = FBox(ForceInit);
+	FBox ComponentsBounds = FBox(ForceInit);
+
+	// Bounds of the static meshes of the class, including the ones added in Blueprint
+	FBox MeshBounds = FBox(ForceInit);
+	TArray<FVector> InnerPaths;
+};
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnDungeonGenerated, bool, Success);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnDungeonCellsChanged, FIntVector, Chunk);
+
 UCLASS()
 class NETWORKINGPROTOTYPE_API ADungeonGenerator : public AActor
 {
 	GENERATED_BODY()
+
+	friend class FDungeonMaterializer;
 	
 public:	
 	// Sets default values for this actor's properties
@@ -50,11 +125,21 @@ protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
 
+	// Called when the actor is removed, stops the background generation
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	// Only replicate the room locations when the actors are replicated
+	virtual void PreReplication(IChangedPropertyTracker& ChangedPropertyTracker) override;
+
+	// Rebuild the dungeon of the server
+	UFUNCTION()
+	void OnRep_GenerationParams();
+
 	// Helper function to get random room properties
-	void GetRandomRoomProperties(TArray<FVector>& locations, FVector& scale);
+	void GetRandomRoomProperties(const FRandomStream& stream, TArray<FVector>& locations, FVector& scale);
 
 	// Helper function to get a random number within an interval
-	int GetRandomNumberWithInterval(int min, int max) const;
+	int GetRandomNumberWithInterval(const FRandomStream& stream, int min, int max) const;
 
 	// Helper function to check if new room location intersects with existing rooms
 	bool ChckeRoomIntersection(const FBox& roomA, const FBox& roomB);
@@ -62,13 +147,12 @@ protected:
 	// Get all integer points in a box
 	TArray<FVector> GetAllIntegerPointsInBox(const FBox& Box);
 
-	// Kruskal’s Algorithm to find the minimum spanning tree(MST)
-	TArray<FEdge> MinimumSpanningTree(const TArray<FEdge>& edges, const FVector& startVertex);
-
-	// Add random edges to the MST to create a more complex dungeon
-	TArray<FEdge> AddRandomEdgesToMST(const TArray<FEdge>& originalEdges, TArray<FEdge>& mstEdges, float additionalEdgeProbability);
+	// Random stream of a stage, salt separates floors or groups within the stage
+	FRandomStream MakeRandomStream(EDungeonGenerationStage stage, int salt = 0) const;
 
 	// Generate rooms
+	bool GenerateEntranceRoom(const FTransform& startingPoint);
+	void GenerateNextRoom();
 	void GenerateProcGenRooms();
 	void GeneratePremadeRooms();
 	void RoomCountCalculation(const FVector& centerRoomLocation);
@@ -76,11 +160,52 @@ protected:
 	// Generate the Optimal path between rooms based on the floor
 	void FindPossibleHallwaysNormal();
 	void FindPossibleHallwaysFloorBased();
-	void GenerateNormalHallways();
-	void GenerateFloorBasedHallways();
+	void BeginHallways();
+	void QueueNormalHallways();
+	void QueueFloorBasedHallways();
+	FVector GetRoomGroupVertex(int groupIndex) const;
+	FDungeonEdge SelectDoorCandidates(const FDungeonEdge& edge) const;
+	bool RouteNextHallway(int maxExpansions);
+	void CarveHallwayPath(const TArray<FVector>& path);
+	void AddRoomDoorPoint(const FVector& anchor, const FVector& doorPoint);
+	FVector GetRoomAnchor(const FBox& roomBounds) const;
+	FBox GetPlacementBounds(const FVector& location, const FVector& scale) const;
+	uint8 GetNeighborMask2D(const FVector& pos) const;
+	bool IsNextToStairs(const FVector& cell) const;
+
+	// Generation state machine
+	void StartGeneration(const FTransform& startingPoint, int roomCount);
+	void ResetGeneration(const FTransform& startingPoint, int roomSpawnSteps);
+	bool StepGeneration(int maxPathExpansions, int maxSpawns = MAX_int32);
+	void AdvanceGeneration(float budgetMs);
+	void BeginMaterializeDungeon();
+	TArray<FVector> GetSpawnPriorityOrigins() const;
+	void SetGenerationStage(EDungeonGenerationStage stage);
+	void UpdateGenerationProgress();
+	void PublishGenerationProgress(EDungeonGenerationStage stage, float progress);
+	void FinishGeneration();
+	void DrawDebugGrid();
+
+	// Cell replication
+	void SnapshotCellChunks();
+	void FlushDirtyCellChunks();
+	void ApplyReplicatedCells();
+
+	// Background generation
+	void LaunchBackgroundGeneration();
+	void StopBackgroundGeneration();
+	bool PollBackgroundGeneration();
 
 	// Clean up the dungeon
 	void CleanUpDungeon();
+	TBitArray<> FindReachableRoomGroups() const;
+
+	// Merge structures
+	void MergeCoplanarPieces(TArray<FDungeonPiece>& pieces, int axisA, int axisB);
+
+	// Prefab defaults
+	void CachePrefabInfo();
+	const FDungeonPrefabInfo& GetPrefabInfo(TSubclassOf<AMainRoom> prefab);
 
 	// Update Navmesh
 	void UpdateNavMesh(AMainRoom* room);
@@ -94,28 +219,65 @@ protected:
 	// Cost function
 	DungeonPathInfo CostFunction(const DungeonNode& a, const DungeonNode& b, const FVector& endPos); 
 
-	Grid3D<EStructureType> grid;
+	// generated dungeon
+	FDungeonLayout layout;
+	FDungeonMaterializer materializer;
 
-	// rooms
-	TArray<TArray<AMainRoom*>> spawnedRooms;
-	TArray<FBox> premadeBounds;
-
-	TMap<int, TArray<AMainRoom*>> floorRoomMap;
+	// floors, rooms are in the room table of the layout
 	TMap<int, TArray<FVector>> floorVertexMap;
 	TMap<int, TArray<FVector>> floorStairVertexMap;
-	TMap<int, TArray<FEdge>> floorEdgeMap;
-	TMap<AMainRoom*, TArray<AMainRoom*>> cleanupMap;
+	TMap<int, TArray<FDungeonEdge>> floorEdgeMap;
 
-	// doors
-	TMap<FVector, ABasicDoor*> spawnedDoors;
+	// prefabs
+	TMap<UClass*, FDungeonPrefabInfo> prefabInfoMap;
 	
 	// algorithms
+	FRandomStream roomStream;
 	UE::Geometry::FDelaunay3 delaunay;
 	DungeonPathfinder3D pathfinder;
 	
 	TArray<FVector> roomVertices;
-	TArray<FVector> hallwaysVertices;
-	TArray<FEdge> selectedEdges;
+	TArray<FDungeonEdge> selectedEdges;
+
+	// group of each vertex when triangulating room groups
+	TMap<FVector, int> vertexGroupMap;
+
+	// hallway routing, door links pair a room with the hallway path its door is on
+	TArray<FHallwayRequest> hallwayQueue;
+	int hallwayCursor = 0;
+	TArray<FIntPoint> hallwayDoorLinks;
+
+	// generation steps
+	EDungeonGenerationStage currentStage = EDungeonGenerationStage::IDLE;
+	FTransform generationStartingPoint = FTransform::Identity;
+	int generationRoomSteps = 0;
+	int generationRoomStep = 0;
+
+	// background generation
+	UE::Tasks::FTask generationTask;
+	TSharedPtr<std::atomic<bool>, ESPMode::ThreadSafe> generationCancelToken;
+	std::atomic<EDungeonGenerationStage> backgroundStage { EDungeonGenerationStage::IDLE };
+	std::atomic<float> backgroundProgress { 0.0f };
+
+	// time spent in each stage and hallways without a path
+	TArray<double> stageSeconds;
+	int failedHallwayCount = 0;
+
+	// hallway searches recorded for offline replay
+	FDungeonPathCapture pathCapture;
+	bool isCapturingPaths = false;
+
+	// layout cache
+	FDungeonLayoutCacheKey layoutCacheKey;
+	bool isLayoutFromCache = false;
+	UE::Tasks::FTask layoutCacheSaveTask;
+
+	// chunks with cells changed since the last flush
+	TSet<FIntVector> dirtyCellChunks;
+
+	// generation of the local layout, counted by the server, clients take it from the replicated params or chunks
+	int32 cellGeneration = 0;
+	bool hasClientCells = false;
 
 	// room count
 	int currentGroundFloorRoomCount = 0;
@@ -134,14 +296,6 @@ public:
 	// Called every frame
 	virtual void Tick(float DeltaTime) override;
 
-	// Spawn the a room at the transform location
-	UFUNCTION(BlueprintCallable)
-	AMainRoom* SpawnStructure(FTransform transform, TSubclassOf<AMainRoom> room, bool checkCollision);
-
-	// Spawn door at the transform location
-	UFUNCTION(BlueprintCallable)
-	ABasicDoor* SpawnDoor(FTransform transform, TSubclassOf<ABasicDoor> door);
-
 	// Generate the dungeon
 	UFUNCTION(BlueprintCallable)
 	void GenerateRooms(FTransform startingPoint, int roomSpawnSteps);
@@ -169,15 +323,70 @@ public:
 	UFUNCTION(BlueprintCallable)
 	void GenerateWalls();
 
+	// Spawn the actors of the generated dungeon
+	UFUNCTION(BlueprintCallable)
+	void MaterializeDungeon();
+
+	// Get the class of a prefab referenced by the layout
+	TSubclassOf<AMainRoom> GetPrefabClass(EDungeonPrefabType prefabType, int prefabIndex) const;
+
+	// Get the generated dungeon
+	const FDungeonLayout& GetLayout() const;
+
+	// Get the actor of a room, null while it is still waiting to be spawned
+	UFUNCTION(BlueprintCallable)
+	AMainRoom* GetRoomActor(int roomIndex) const;
+
+	UFUNCTION(BlueprintPure)
+	bool IsRoomActorPending(int roomIndex) const;
+
 	UFUNCTION(BlueprintCallable)
 	void GenerateDungeon(FTransform startingPoint, int roomCount);
 
+	UFUNCTION(BlueprintPure)
+	bool IsGenerating() const;
+
+	// Stop the current generation, OnDungeonGenerated is broadcast with false
+	UFUNCTION(BlueprintCallable)
+	void CancelGeneration();
+
 	UFUNCTION(BlueprintCallable)
 	FVector GetRandomRoomLocation();
 
 	UFUNCTION(BlueprintCallable)
 	int GetCurrentFloorNumber(const FVector& location) const;
 
+	// Change a cell of the generated dungeon on the server, the change is replicated per chunk
+	UFUNCTION(BlueprintCallable)
+	void SetCellState(const FVector& location, EStructureType state);
+
+	// Clients in actor replication mode read the replicated grid, the cells are NONE until its chunks arrive
+	UFUNCTION(BlueprintPure)
+	EStructureType GetCellState(const FVector& location) const;
+
+	// Write a replicated chunk into the local grid, or clear it once the server removed the chunk
+	void ApplyCellChunk(const FDungeonCellChunk& chunk);
+	void RemoveCellChunk(const FDungeonCellChunk& chunk);
+
+	// Headless generation, only the data stages run so no world or actors are needed
+	void BeginHeadlessGeneration(const FTransform& startingPoint, int roomCount, int seed);
+	bool RunHeadlessGeneration();
+
+	// Results of the last generation
+	const TArray<double>& GetStageSeconds() const;
+	int GetFailedHallwayCount() const;
+	const FPathfinderStats& GetPathfinderStats() const;
+	SIZE_T GetGenerationMemory() const;
+
+	// Key of a layout in the cache, also names the layouts written by tools
+	FDungeonLayoutCacheKey ComputeLayoutCacheKey(const FTransform& startingPoint, int roomCount) const;
+
+	// Route the hallways of a capture again on its layout, only the routing runs so no world is needed
+	bool ReplayPathCapture(const FDungeonPathCapture& capture);
+
+	// Searches of the last capture or replay
+	const FDungeonPathCapture& GetPathCapture() const;
+
 	
 	// ====== Properties ======
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(AllowPrivateAccess="true"), Category="Basic")
@@ -231,6 +440,14 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(AllowPrivateAccess="true", EditCondition = IsDungeonFloorBased), Category="Advanced")
 	bool ShouldGenerateBuilding = false;
 
+	// Merge neighboring ceilings and walls into scaled pieces, the prefabs must be able to stretch
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(AllowPrivateAccess="true"), Category="Advanced")
+	bool MergeCoplanarStructures = false;
+
+	// Triangulate one vertex per room group instead of one per room, hallways attach to the closest rooms of the groups they connect
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(AllowPrivateAccess="true", EditCondition="!IsDungeonFloorBased"), Category="Advanced")
+	bool TriangulateRoomGroups = false;
+
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(AllowPrivateAccess="true"), Category="Advanced")
 	float BaseCost = 100.0f;
 	
@@ -267,6 +484,58 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(AllowPrivateAccess="true"), Category="Prefab")
 	TArray<TSubclassOf<AHallway>> HallwayList;
 
+	// ====== Generation ======
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(AllowPrivateAccess="true"), Category="Generation")
+	EDungeonGenerationMode GenerationMode = EDungeonGenerationMode::SYNCHRONOUS;
+
+	// Milliseconds per frame the generator is allowed to spend when time sliced
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(AllowPrivateAccess="true", ClampMin="0.1"), Category="Generation")
+	float FrameBudgetMs = 4.0f;
+
+	// Pathfinder node expansions between budget checks when time sliced
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(AllowPrivateAccess="true", ClampMin="1"), Category="Generation")
+	int PathExpansionsPerStep = 256;
+
+	// Actors spawned between budget checks when time sliced
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(AllowPrivateAccess="true", ClampMin="1"), Category="Generation")
+	int SpawnBatchSize = 8;
+
+	// Max actors spawned per frame when time sliced, 0 only uses the frame budget
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(AllowPrivateAccess="true", ClampMin="0"), Category="Generation")
+	int MaxSpawnsPerFrame = 64;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, meta=(AllowPrivateAccess="true"), Category="Generation")
+	EDungeonGenerationStage GenerationStage = EDungeonGenerationStage::IDLE;
+
+	// Progress of the whole generation from 0 to 1
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, meta=(AllowPrivateAccess="true"), Category="Generation")
+	float GenerationProgress = 0.0f;
+
+	// Called when the generation is done or cancelled
+	UPROPERTY(BlueprintAssignable, Category="Generation")
+	FOnDungeonGenerated OnDungeonGenerated;
+
+	// Hallways, walls and ceilings can be batched into instanced meshes instead of actors
+	// The instances aren't replicated, networked games spawn actors unless the replication mode is seed
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(AllowPrivateAccess="true"), Category="Generation")
+	EDungeonMaterializeMode MaterializeMode = EDungeonMaterializeMode::ACTORS;
+
+	// Size of an instanced mesh chunk in cells
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(AllowPrivateAccess="true", ClampMin="1", EditCondition="MaterializeMode==EDungeonMaterializeMode::INSTANCED"), Category="Generation")
+	int InstanceChunkSize = 8;
+
+	// Seed of the generation, a new one is picked every generation if UseRandomSeed is set
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(AllowPrivateAccess="true"), Category="Generation")
+	int Seed = 0;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(AllowPrivateAccess="true"), Category="Generation")
+	bool UseRandomSeed = true;
+
+	// Load layouts generated with the same properties and seed from disk instead of generating them again
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(AllowPrivateAccess="true"), Category="Generation")
+	bool UseLayoutCache = false;
+
 	// ====== Debug Properties ======
 	
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(AllowPrivateAccess="true"), Category="Debug")
@@ -278,7 +547,41 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(AllowPrivateAccess="true"), Category="Debug")
 	bool DebugWithModels = false;
 
+	// Slowest hallway searches kept with their endpoints, logged with the pathfinder statistics in debug mode
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(AllowPrivateAccess="true", ClampMin="0"), Category="Debug")
+	int SlowPathQueryCount = 0;
+
+	// Write the layout, costs and hallway searches of every generation to Saved/DungeonCapture for the replay commandlet
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(AllowPrivateAccess="true"), Category="Debug")
+	bool CaptureHallwaySearches = false;
+
 	// ====== Networking ======
+	// Seed mode only replicates the generation parameters, clients build the structures locally and only doors are replicated
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(AllowPrivateAccess="true"), Category="Networking")
+	EDungeonReplicationMode ReplicationMode = EDungeonReplicationMode::ACTORS;
+	
+	UPROPERTY(ReplicatedUsing=OnRep_GenerationParams, VisibleAnywhere, BlueprintReadOnly, meta=(AllowPrivateAccess="true"))
+	FDungeonGenerationParams ReplicatedGenerationParams;
+
+	// Cells changed after the generation
+	UPROPERTY(Replicated)
+	FDungeonCellChunkArray ReplicatedCells;
+
+	// Structures are only replicated to players on the floors around them
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(AllowPrivateAccess="true"), Category="Networking")
+	bool UseFloorRelevancy = false;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(AllowPrivateAccess="true", ClampMin="0", EditCondition="UseFloorRelevancy"), Category="Networking")
+	int RelevantFloorRange = 1;
+
+	// Number of cells along each side of a replicated chunk
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(AllowPrivateAccess="true", ClampMin="1"), Category="Networking")
+	int CellChunkSize = 8;
+
+	// Called when a chunk of cells changed, on the server and on clients
+	UPROPERTY(BlueprintAssignable, Category="Networking")
+	FOnDungeonCellsChanged OnCellsChanged;
+	
 	UPROPERTY(Replicated, VisibleAnywhere, BlueprintReadOnly, meta=(AllowPrivateAccess="true"))
 	TArray<FVector> ReplicatedRoomLocations;
 
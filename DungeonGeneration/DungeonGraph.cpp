@@ -0,0 +1,111 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DungeonGraph.h"
+#include "DungeonGenerationStats.h"
+
+/*
+ * @brief Find the minimum spanning tree(MST) of the graph
+ * @param const TArray<FDungeonEdge>& edges
+ * @param const FVector& startVertex
+ * @return TArray<FDungeonEdge> The minimum spanning tree
+ */
+TArray<FDungeonEdge> DungeonGraph::MinimumSpanningTree(const TArray<FDungeonEdge>& edges, const FVector& startVertex)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(DungeonGen_MST);
+
+	TSet<FVector> openSet;
+	TSet<FVector> closedSet;
+	TArray<FDungeonEdge> results;
+
+	// Initialize openSet with all vertices in the edges
+	for (const FDungeonEdge& edge : edges)
+	{
+		openSet.Add(edge.Vertex[0]);
+		openSet.Add(edge.Vertex[1]);
+	}
+
+	// Add the start vertex to closedSet
+	closedSet.Add(startVertex);
+
+	while (openSet.Num() > 0)
+	{
+		bool chosen = false;
+		FDungeonEdge chosenEdge;
+		float minWeight = std::numeric_limits<float>::infinity();
+
+		// Find the edge with the minimum weight that connects a closed vertex to an open vertex
+		for (const FDungeonEdge& edge : edges)
+		{
+			int closedVertices = 0;
+			if (!closedSet.Contains(edge.Vertex[0])) closedVertices++;
+			if (!closedSet.Contains(edge.Vertex[1])) closedVertices++;
+
+			if (closedVertices != 1) continue;
+
+			// Calculate the weight of the edge
+			float weight = FVector::Distance(edge.Vertex[0], edge.Vertex[1]);
+			if (weight < minWeight)
+			{
+				chosenEdge = edge;
+				chosen = true;
+				minWeight = weight;
+			}
+		}
+
+		// If no edge was chosen, break out of the loop
+		if (!chosen) break;
+
+		// Add the chosen edge to the results
+		results.Add(chosenEdge);
+		openSet.Remove(chosenEdge.Vertex[0]);
+		openSet.Remove(chosenEdge.Vertex[1]);
+		closedSet.Add(chosenEdge.Vertex[0]);
+		closedSet.Add(chosenEdge.Vertex[1]);
+	}
+
+	return results;
+}
+
+/*
+ * @brief Add random edges to the MST to create a more complex dungeon
+ * @param const FRandomStream& stream
+ * @param const TArray<FDungeonEdge>& edges All edges of the graph
+ * @param const TArray<FDungeonEdge>& treeEdges
+ * @param float additionalEdgeProbability Chance of each remaining edge to be added
+ * @return TArray<FDungeonEdge> The tree and the added edges
+ */
+TArray<FDungeonEdge> DungeonGraph::AddRandomEdges(const FRandomStream& stream, const TArray<FDungeonEdge>& edges, const TArray<FDungeonEdge>& treeEdges,
+	float additionalEdgeProbability)
+{
+	TArray<FDungeonEdge> mazeEdges = treeEdges;
+
+	// Filter out the edges that are not part of the MST
+	TArray<FDungeonEdge> remainingEdges;
+	for (const FDungeonEdge& edge : edges)
+	{
+		if (!treeEdges.Contains(edge))
+		{
+			remainingEdges.Add(edge);
+		}
+	}
+
+	// Shuffle remaining edges to randomize their order
+	int32 numEdges = remainingEdges.Num();
+	for (int32 i = numEdges - 1; i > 0; --i)
+	{
+		int32 j = stream.RandRange(0, i); // Random index from 0 to i
+		remainingEdges.Swap(i, j); // Swap elements to shuffle
+	}
+
+	// Add random remaining edges to the maze
+	for (const FDungeonEdge& edge : remainingEdges)
+	{
+		if (stream.FRand() < additionalEdgeProbability)
+		{
+			mazeEdges.Add(edge);
+		}
+	}
+
+	return mazeEdges;
+}
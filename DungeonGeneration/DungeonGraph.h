@@ -0,0 +1,44 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+// Undirected edge between two room vertices
+struct FDungeonEdge
+{
+	FVector Vertex[2] = { FVector::ZeroVector, FVector::ZeroVector };
+
+	FDungeonEdge() = default;
+
+	FDungeonEdge(const FVector& a, const FVector& b)
+	{
+		Vertex[0] = a;
+		Vertex[1] = b;
+	}
+
+	bool operator==(const FDungeonEdge& other) const
+	{
+		return (Vertex[0] == other.Vertex[0] && Vertex[1] == other.Vertex[1])
+			|| (Vertex[0] == other.Vertex[1] && Vertex[1] == other.Vertex[0]);
+	}
+};
+
+// A hallway waiting to be routed by the pathfinder
+struct FHallwayRequest
+{
+	FDungeonEdge Edge;
+	bool CanChangeFloors = true;
+};
+
+/**
+ * Graph helpers of the hallway planning, they only depend on Core
+ */
+namespace DungeonGraph
+{
+	// Prim's algorithm from the start vertex, edges connecting two closed vertices are skipped
+	NETWORKINGPROTOTYPE_API TArray<FDungeonEdge> MinimumSpanningTree(const TArray<FDungeonEdge>& edges, const FVector& startVertex);
+
+	// Add edges of the graph that are not in the tree to create loops
+	NETWORKINGPROTOTYPE_API TArray<FDungeonEdge> AddRandomEdges(const FRandomStream& stream, const TArray<FDungeonEdge>& edges, const TArray<FDungeonEdge>& treeEdges, float additionalEdgeProbability);
+}
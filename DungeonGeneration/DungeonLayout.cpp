@@ -0,0 +1,265 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DungeonLayout.h"
+#include "Algo/StableSort.h"
+
+/*
+ * @brief Clear the layout and the grid, the allocations are kept for the next generation
+ * @param const FVector& size of the dungeon
+ * @param int unit size of a cell
+ */
+void FDungeonLayout::Reset(const FVector& size, int unit)
+{
+	Grid.Reset(size, unit, unit);
+	RoomAnchors.Reset(size, unit, unit);
+	
+	Rooms.Reset();
+	RoomTable.Reset();
+	RoomGroups.Reset();
+	PremadeRooms.Reset();
+	RoomLocations.Reset();
+	
+	HallwayPaths.Reset();
+	HallwayCells.Reset();
+	
+	Stairs.Reset();
+	Ceilings.Reset();
+	Walls.Reset();
+	Doors.Reset();
+	DoorPositions.Reset();
+}
+
+/*
+ * @brief Add a room to the records, the room table and a group
+ * @param const FDungeonRoomData& room
+ * @param int group Index of the room group, INDEX_NONE to keep the room out of the groups
+ * @param int floor Z of the floor the room is on, INDEX_NONE to keep the room out of the floors
+ * @param const FBox& placementBounds Bounds new rooms may not intersect
+ * @return int Index of the room
+ */
+int FDungeonLayout::AddRoom(const FDungeonRoomData& room, int group, int floor, const FBox& placementBounds)
+{
+	const int roomIndex = Rooms.Add(room);
+	RoomTable.Add(room.Bounds, placementBounds, group, floor, room.PrefabType);
+	if(group != INDEX_NONE)
+	{
+		RoomGroups[group].Add(roomIndex);
+	}
+	return roomIndex;
+}
+
+/*
+ * @brief Add a door if there is none at the position yet
+ * @param const FVector& position of the door between two cells
+ * @param const FTransform& transform of the door
+ */
+void FDungeonLayout::AddDoor(const FVector& position, const FTransform& transform)
+{
+	if(DoorPositions.Contains(position))
+		return;
+
+	DoorPositions.Add(position);
+	Doors.Add(FDungeonPiece(EDungeonPrefabType::DOOR, 0, transform));
+}
+
+/*
+ * @brief Register the room anchored at a cell, anchors outside the grid are ignored
+ * @param const FVector& anchor
+ * @param int roomIndex Index in the room table
+ */
+void FDungeonLayout::SetRoomAnchor(const FVector& anchor, int roomIndex)
+{
+	if(!Grid.InBoundsIgnoreOffset(anchor))
+		return;
+
+	RoomAnchors[anchor] = roomIndex + 1;
+}
+
+/*
+ * @brief Get the room anchored at a cell
+ * @param const FVector& anchor
+ * @return int Index in the room table, INDEX_NONE if no room is anchored at the cell
+ */
+int FDungeonLayout::GetRoomAtAnchor(const FVector& anchor) const
+{
+	if(!Grid.InBoundsIgnoreOffset(anchor))
+		return INDEX_NONE;
+
+	return RoomAnchors[anchor] - 1;
+}
+
+/*
+ * @brief Hash the rooms and structures, equal layouts have equal checksums
+ * @return uint32 Checksum
+ */
+uint32 FDungeonLayout::ComputeChecksum() const
+{
+	uint32 checksum = 0;
+	
+	auto hashTransform = [&checksum](const FTransform& transform)
+	{
+		const FVector location = transform.GetLocation();
+		const FRotator rotation = transform.Rotator();
+		const FVector scale = transform.GetScale3D();
+		checksum = FCrc::MemCrc32(&location, sizeof(location), checksum);
+		checksum = FCrc::MemCrc32(&rotation, sizeof(rotation), checksum);
+		checksum = FCrc::MemCrc32(&scale, sizeof(scale), checksum);
+	};
+	
+	auto hashPieces = [&checksum, &hashTransform](const TArray<FDungeonPiece>& pieces)
+	{
+		for(auto& piece : pieces)
+		{
+			checksum = HashCombine(checksum, GetTypeHash(static_cast<uint8>(piece.PrefabType)));
+			checksum = HashCombine(checksum, GetTypeHash(piece.PrefabIndex));
+			hashTransform(piece.Transform);
+		}
+	};
+
+	for(auto& room : Rooms)
+	{
+		checksum = HashCombine(checksum, GetTypeHash(static_cast<uint8>(room.PrefabType)));
+		checksum = HashCombine(checksum, GetTypeHash(room.PrefabIndex));
+		hashTransform(room.Transform);
+	}
+
+	for(auto& roomGroup : RoomGroups)
+	{
+		checksum = FCrc::MemCrc32(roomGroup.GetData(), roomGroup.Num() * sizeof(int), checksum);
+	}
+
+	checksum = FCrc::MemCrc32(HallwayCells.GetData(), HallwayCells.Num() * sizeof(FVector), checksum);
+	hashPieces(Stairs);
+	hashPieces(Ceilings);
+	hashPieces(Walls);
+	hashPieces(Doors);
+
+	return checksum;
+}
+
+/*
+ * @brief Get the memory used by the layout
+ * @return SIZE_T bytes
+ */
+SIZE_T FDungeonLayout::GetAllocatedSize() const
+{
+	SIZE_T bytes = Grid.GetAllocatedSize();
+	bytes += RoomAnchors.GetAllocatedSize();
+	
+	bytes += Rooms.GetAllocatedSize();
+	for(auto& room : Rooms)
+	{
+		bytes += room.DoorPoints.GetAllocatedSize();
+	}
+	bytes += RoomTable.GetAllocatedSize();
+	bytes += RoomGroups.GetAllocatedSize();
+	for(auto& roomGroup : RoomGroups)
+	{
+		bytes += roomGroup.GetAllocatedSize();
+	}
+	bytes += PremadeRooms.GetAllocatedSize();
+	for(auto& premade : PremadeRooms)
+	{
+		bytes += premade.Value.GetAllocatedSize();
+	}
+	bytes += RoomLocations.GetAllocatedSize();
+
+	bytes += HallwayPaths.GetAllocatedSize();
+	for(auto& path : HallwayPaths)
+	{
+		bytes += path.GetAllocatedSize();
+	}
+	bytes += HallwayCells.GetAllocatedSize();
+
+	bytes += Stairs.GetAllocatedSize();
+	bytes += Ceilings.GetAllocatedSize();
+	bytes += Walls.GetAllocatedSize();
+	bytes += Doors.GetAllocatedSize();
+	bytes += DoorPositions.GetAllocatedSize();
+	
+	return bytes;
+}
+
+// ============ Room Table ============
+
+/*
+ * @brief Add the columns of a room
+ * @param const FBox& bounds
+ * @param const FBox& placementBounds
+ * @param int group
+ * @param int floor
+ * @param EDungeonPrefabType prefabType
+ * @return int Index of the room
+ */
+int FDungeonRoomTable::Add(const FBox& bounds, const FBox& placementBounds, int group, int floor, EDungeonPrefabType prefabType)
+{
+	Bounds.Add(bounds);
+	PlacementBounds.Add(placementBounds);
+	Groups.Add(group);
+	Floors.Add(floor);
+	return PrefabTypes.Add(prefabType);
+}
+
+/*
+ * @brief Clear the table, the allocations are kept
+ */
+void FDungeonRoomTable::Reset()
+{
+	Bounds.Reset();
+	PlacementBounds.Reset();
+	Groups.Reset();
+	Floors.Reset();
+	PrefabTypes.Reset();
+	FloorRooms.Reset();
+	FloorRanges.Reset();
+}
+
+/*
+ * @brief Sort the rooms on a floor by floor, rooms of a floor keep the order they were added in
+ */
+void FDungeonRoomTable::BuildFloorRanges()
+{
+	FloorRooms.Reset();
+	FloorRanges.Reset();
+	
+	for(int i = 0; i<Floors.Num(); ++i)
+	{
+		if(Floors[i] != INDEX_NONE)
+		{
+			FloorRooms.Add(i);
+		}
+	}
+	Algo::StableSort(FloorRooms, [this](int32 a, int32 b) { return Floors[a] < Floors[b]; });
+
+	for(int i = 0; i<FloorRooms.Num(); ++i)
+	{
+		const int32 floor = Floors[FloorRooms[i]];
+		if(FloorRanges.IsEmpty() || FloorRanges.Last().Floor != floor)
+		{
+			FDungeonFloorRange& range = FloorRanges.AddDefaulted_GetRef();
+			range.Floor = floor;
+			range.First = i;
+		}
+		FloorRanges.Last().Count++;
+	}
+}
+
+/*
+ * @brief Get the number of rooms
+ * @return int
+ */
+int FDungeonRoomTable::Num() const
+{
+	return PrefabTypes.Num();
+}
+
+/*
+ * @brief Get the memory used by the columns
+ * @return SIZE_T bytes
+ */
+SIZE_T FDungeonRoomTable::GetAllocatedSize() const
+{
+	return Bounds.GetAllocatedSize() + PlacementBounds.GetAllocatedSize() + Groups.GetAllocatedSize() + Floors.GetAllocatedSize()
+		+ PrefabTypes.GetAllocatedSize() + FloorRooms.GetAllocatedSize() + FloorRanges.GetAllocatedSize();
+}
@@ -0,0 +1,144 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Grid3D.h"
+#include "DungeonLayout.generated.h"
+
+UENUM(BlueprintType)
+enum class EStructureType : uint8
+{
+	NONE	UMETA(DisplayName="None"),
+	STOP	UMETA(DisplayName="Stop"),
+	ROOM	UMETA(DisplayName="Room"),
+	GROUND	UMETA(DisplayName="Ground"),
+	HALLWAY	UMETA(DisplayName="Hallway"),
+	STAIRS	UMETA(DisplayName="Stairs")
+};
+
+// Prefab list of the generator a layout entry refers to
+enum class EDungeonPrefabType : uint8
+{
+	ENTRANCE,
+	ROOM,
+	PREMADE,
+	PREMADE_PATH,
+	HALLWAY,
+	STAIRS,
+	WALL,
+	DOOR
+};
+
+// A room placed by the generator
+struct FDungeonRoomData
+{
+	EDungeonPrefabType PrefabType = EDungeonPrefabType::ROOM;
+	int PrefabIndex = 0;
+	FTransform Transform = FTransform::Identity;
+	FVector Scale = FVector::OneVector;
+	FBox Bounds = FBox(ForceInit);
+	TArray<FVector> DoorPoints;
+	bool IsConnectedToHallway = false;
+	bool CheckCollision = true;
+};
+
+// A structure without room data, e.g. hallways, stairs, walls and ceilings
+struct FDungeonPiece
+{
+	EDungeonPrefabType PrefabType = EDungeonPrefabType::WALL;
+	int PrefabIndex = 0;
+	FTransform Transform = FTransform::Identity;
+
+	// Invalid bounds use the bounds of the spawned actor
+	FBox Bounds = FBox(ForceInit);
+
+	FDungeonPiece() = default;
+	FDungeonPiece(EDungeonPrefabType prefabType, int prefabIndex, const FTransform& transform, const FBox& bounds = FBox(ForceInit))
+		: PrefabType(prefabType), PrefabIndex(prefabIndex), Transform(transform), Bounds(bounds)
+	{
+	}
+};
+
+// Pieces planned by one slab or room group of a decoration pass, appended to the layout in slab order
+struct FDungeonPiecePlan
+{
+	TArray<FDungeonPiece> Walls;
+	TArray<FDungeonPiece> Ceilings;
+
+	// Doors are deduplicated by position when the plan is appended
+	TArray<FDungeonPiece> Doors;
+};
+
+// Rooms of one floor, a range of the floor ordered rooms of the room table
+struct FDungeonFloorRange
+{
+	int32 Floor = 0;
+	int32 First = 0;
+	int32 Count = 0;
+};
+
+/**
+ * Columns of the rooms read in the loops of the generation stages, indexed like the room records
+ * The records keep what is only read once per room, e.g. transforms and door points for materializing
+ */
+struct NETWORKINGPROTOTYPE_API FDungeonRoomTable
+{
+	int Add(const FBox& bounds, const FBox& placementBounds, int group, int floor, EDungeonPrefabType prefabType);
+	void Reset();
+	void BuildFloorRanges();
+	int Num() const;
+	SIZE_T GetAllocatedSize() const;
+
+	TArray<FBox> Bounds;
+
+	// Bounds tested against new rooms
+	TArray<FBox> PlacementBounds;
+
+	// INDEX_NONE for rooms outside the groups and floors, e.g. premade rooms are only represented by their paths
+	TArray<int32> Groups;
+	TArray<int32> Floors;
+	TArray<EDungeonPrefabType> PrefabTypes;
+
+	// Rooms sorted by floor in the order they were added, built once the rooms are placed
+	TArray<int32> FloorRooms;
+	TArray<FDungeonFloorRange> FloorRanges;
+};
+
+/**
+ * Plain data of a generated dungeon, it doesn't know about actors
+ */
+struct NETWORKINGPROTOTYPE_API FDungeonLayout
+{
+	void Reset(const FVector& size, int unit);
+	int AddRoom(const FDungeonRoomData& room, int group, int floor, const FBox& placementBounds);
+	void AddDoor(const FVector& position, const FTransform& transform);
+	void SetRoomAnchor(const FVector& anchor, int roomIndex);
+	int GetRoomAtAnchor(const FVector& anchor) const;
+	uint32 ComputeChecksum() const;
+	SIZE_T GetAllocatedSize() const;
+	
+	// cells
+	Grid3D<EStructureType> Grid;
+
+	// Room anchored at each cell plus one, 0 if there is none, so hallways find the room they leave without a search
+	Grid3D<int32> RoomAnchors;
+
+	// rooms, groups and premade rooms store indices into the room table
+	TArray<FDungeonRoomData> Rooms;
+	FDungeonRoomTable RoomTable;
+	TArray<TArray<int>> RoomGroups;
+	TMap<int, TArray<int>> PremadeRooms;
+	TArray<FVector> RoomLocations;
+
+	// hallways
+	TArray<TArray<FVector>> HallwayPaths;
+	TArray<FVector> HallwayCells;
+
+	// structures
+	TArray<FDungeonPiece> Stairs;
+	TArray<FDungeonPiece> Ceilings;
+	TArray<FDungeonPiece> Walls;
+	TArray<FDungeonPiece> Doors;
+	TSet<FVector> DoorPositions;
+};
@@ -0,0 +1,516 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DungeonLayoutCache.h"
+#include "HAL/PlatformFileManager.h"
+#include "Async/MappedFileHandle.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+namespace DungeonLayoutCache
+{
+	static constexpr uint32 Magic = 0x59414C44; // "DLAY"
+
+	// Records are plain data so whole sections can be copied at once
+	struct FCachedTransform
+	{
+		FQuat Rotation;
+		FVector Location;
+		FVector Scale;
+	};
+
+	struct FCachedRoom
+	{
+		FCachedTransform Transform;
+		FVector Scale;
+		FVector BoundsMin;
+		FVector BoundsMax;
+		FVector PlacementBoundsMin;
+		FVector PlacementBoundsMax;
+		int32 PrefabIndex;
+		int32 DoorPointCount;
+		int32 Group;
+		int32 Floor;
+		uint8 PrefabType;
+		uint8 IsBoundsValid;
+		uint8 IsPlacementBoundsValid;
+		uint8 IsConnectedToHallway;
+		uint8 CheckCollision;
+	};
+
+	struct FCachedPiece
+	{
+		FCachedTransform Transform;
+		FVector BoundsMin;
+		FVector BoundsMax;
+		int32 PrefabIndex;
+		uint8 PrefabType;
+		uint8 IsBoundsValid;
+	};
+
+	static FCachedTransform ToCached(const FTransform& transform)
+	{
+		return FCachedTransform{ transform.GetRotation(), transform.GetLocation(), transform.GetScale3D() };
+	}
+
+	static FTransform FromCached(const FCachedTransform& transform)
+	{
+		return FTransform(transform.Rotation, transform.Location, transform.Scale);
+	}
+
+	static FBox MakeBox(const FVector& min, const FVector& max, uint8 isValid)
+	{
+		return isValid ? FBox(min, max) : FBox(ForceInit);
+	}
+
+	// Write next to the target first so a reader never maps a half written file
+	static bool WriteBuffer(const TArray<uint8>& buffer, const FString& path)
+	{
+		const FString tempPath = path + TEXT(".tmp");
+		if(!FFileHelper::SaveArrayToFile(buffer, *tempPath))
+		{
+			UE_LOG(LogTemp, Error, TEXT("Failed to write the layout cache %s!"), *tempPath);
+			return false;
+		}
+		
+		return IFileManager::Get().Move(*path, *tempPath, true);
+	}
+
+	// Appends blocks to the file buffer
+	struct FWriter
+	{
+		TArray<uint8>& Buffer;
+
+		template<typename T>
+		void Write(const T& value)
+		{
+			WriteBlock(&value, 1);
+		}
+
+		template<typename T>
+		void WriteBlock(const T* values, int32 count)
+		{
+			Buffer.Append(reinterpret_cast<const uint8*>(values), count * sizeof(T));
+		}
+
+		// Nested arrays are stored as a count per array followed by all elements
+		template<typename T>
+		void WriteNested(const TArray<TArray<T>>& arrays)
+		{
+			Write(arrays.Num());
+			for(auto& array : arrays)
+			{
+				Write(array.Num());
+			}
+			for(auto& array : arrays)
+			{
+				WriteBlock(array.GetData(), array.Num());
+			}
+		}
+	};
+
+	// Copies blocks out of the mapped file, fails instead of reading past the end
+	struct FReader
+	{
+		const uint8* Data;
+		int64 Size;
+		int64 Offset = 0;
+
+		template<typename T>
+		bool Read(T& value)
+		{
+			return ReadBlock(&value, 1);
+		}
+
+		template<typename T>
+		bool ReadBlock(T* values, int32 count)
+		{
+			const int64 bytes = static_cast<int64>(count) * sizeof(T);
+			if(count < 0 || Offset + bytes > Size)
+				return false;
+
+			FMemory::Memcpy(values, Data + Offset, bytes);
+			Offset += bytes;
+			return true;
+		}
+
+		template<typename T>
+		bool ReadArray(TArray<T>& values, int32 count)
+		{
+			if(count < 0 || Offset + static_cast<int64>(count) * sizeof(T) > Size)
+				return false;
+			
+			values.SetNumUninitialized(count);
+			return ReadBlock(values.GetData(), count);
+		}
+
+		template<typename T>
+		bool ReadNested(TArray<TArray<T>>& arrays)
+		{
+			int32 count = 0;
+			TArray<int32> counts;
+			if(!Read(count) || !ReadArray(counts, count))
+				return false;
+
+			arrays.SetNum(count);
+			for(int i = 0; i<count; ++i)
+			{
+				if(!ReadArray(arrays[i], counts[i]))
+					return false;
+			}
+			return true;
+		}
+	};
+
+	static void WritePieces(FWriter& writer, const TArray<FDungeonPiece>& pieces)
+	{
+		TArray<FCachedPiece> records;
+		records.SetNumZeroed(pieces.Num());
+		for(int i = 0; i<pieces.Num(); ++i)
+		{
+			const FDungeonPiece& piece = pieces[i];
+			FCachedPiece& record = records[i];
+			record.Transform = ToCached(piece.Transform);
+			record.BoundsMin = piece.Bounds.Min;
+			record.BoundsMax = piece.Bounds.Max;
+			record.PrefabIndex = piece.PrefabIndex;
+			record.PrefabType = static_cast<uint8>(piece.PrefabType);
+			record.IsBoundsValid = piece.Bounds.IsValid;
+		}
+		
+		writer.Write(records.Num());
+		writer.WriteBlock(records.GetData(), records.Num());
+	}
+
+	static bool ReadPieces(FReader& reader, TArray<FDungeonPiece>& pieces)
+	{
+		int32 count = 0;
+		TArray<FCachedPiece> records;
+		if(!reader.Read(count) || !reader.ReadArray(records, count))
+			return false;
+
+		pieces.Reset(count);
+		for(auto& record : records)
+		{
+			pieces.Add(FDungeonPiece(
+				static_cast<EDungeonPrefabType>(record.PrefabType),
+				record.PrefabIndex,
+				FromCached(record.Transform),
+				MakeBox(record.BoundsMin, record.BoundsMax, record.IsBoundsValid)
+			));
+		}
+		return true;
+	}
+}
+
+/*
+ * @brief Get the file of a cached layout
+ * @param uint32 key Hash of the generation parameters
+ * @return FString Path in the saved directory
+ */
+FString FDungeonLayoutCache::GetCachePath(uint32 key)
+{
+	return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("DungeonCache"), FString::Printf(TEXT("%08x.dlay"), key));
+}
+
+/*
+ * @brief Write a layout to the cache
+ * @param const FDungeonLayout& layout
+ * @param const FDungeonLayoutCacheKey& key Hash and inputs of the generation parameters
+ * @return bool True if the file was written
+ */
+bool FDungeonLayoutCache::Save(const FDungeonLayout& layout, const FDungeonLayoutCacheKey& key)
+{
+	return SaveToFile(layout, key, GetCachePath(key.Hash));
+}
+
+/*
+ * @brief Write a layout to the cache on a worker, the layout is copied into the file buffer before returning
+ * @param const FDungeonLayout& layout
+ * @param const FDungeonLayoutCacheKey& key Hash and inputs of the generation parameters
+ * @return UE::Tasks::FTask Task writing the file
+ */
+UE::Tasks::FTask FDungeonLayoutCache::SaveAsync(const FDungeonLayout& layout, const FDungeonLayoutCacheKey& key)
+{
+	TArray<uint8> buffer;
+	SaveToBuffer(layout, key, buffer);
+
+	return UE::Tasks::Launch(UE_SOURCE_LOCATION, [buffer = MoveTemp(buffer), path = GetCachePath(key.Hash)]()
+	{
+		DungeonLayoutCache::WriteBuffer(buffer, path);
+	});
+}
+
+/*
+ * @brief Append a layout in the cache format to a buffer, e.g. to embed it in another file
+ * @param const FDungeonLayout& layout
+ * @param const FDungeonLayoutCacheKey& key Hash and inputs of the generation parameters
+ * @param TArray<uint8>& buffer
+ */
+void FDungeonLayoutCache::SaveToBuffer(const FDungeonLayout& layout, const FDungeonLayoutCacheKey& key, TArray<uint8>& buffer)
+{
+	using namespace DungeonLayoutCache;
+	
+	FWriter writer{ buffer };
+	writer.Write(Magic);
+	writer.Write(Version);
+	writer.Write(key.Hash);
+	writer.Write(key.Inputs.Num());
+	writer.WriteBlock(key.Inputs.GetData(), key.Inputs.Num());
+
+	// grid
+	const FIntVector cellCount = layout.Grid.GetCellCount();
+	writer.Write(layout.Grid.GetSize());
+	writer.Write(layout.Grid.GetUnit());
+	writer.Write(cellCount);
+	for(int z = 0; z<cellCount.Z; ++z)
+	{
+		for(int y = 0; y<cellCount.Y; ++y)
+		{
+			const TArray<EStructureType>& row = layout.Grid.GetRow(y, z);
+			writer.WriteBlock(row.GetData(), row.Num());
+		}
+	}
+	for(int z = 0; z<cellCount.Z; ++z)
+	{
+		for(int y = 0; y<cellCount.Y; ++y)
+		{
+			const TArray<int32>& row = layout.RoomAnchors.GetRow(y, z);
+			writer.WriteBlock(row.GetData(), row.Num());
+		}
+	}
+
+	// rooms
+	TArray<FCachedRoom> rooms;
+	TArray<FVector> doorPoints;
+	rooms.SetNumZeroed(layout.Rooms.Num());
+	for(int i = 0; i<layout.Rooms.Num(); ++i)
+	{
+		const FDungeonRoomData& room = layout.Rooms[i];
+		FCachedRoom& record = rooms[i];
+		record.Transform = ToCached(room.Transform);
+		record.Scale = room.Scale;
+		record.BoundsMin = room.Bounds.Min;
+		record.BoundsMax = room.Bounds.Max;
+		record.PrefabIndex = room.PrefabIndex;
+		record.DoorPointCount = room.DoorPoints.Num();
+		record.PrefabType = static_cast<uint8>(room.PrefabType);
+		record.IsBoundsValid = room.Bounds.IsValid;
+
+		// The table columns that aren't copies of the room
+		const FBox& placementBounds = layout.RoomTable.PlacementBounds[i];
+		record.PlacementBoundsMin = placementBounds.Min;
+		record.PlacementBoundsMax = placementBounds.Max;
+		record.IsPlacementBoundsValid = placementBounds.IsValid;
+		record.Group = layout.RoomTable.Groups[i];
+		record.Floor = layout.RoomTable.Floors[i];
+		record.IsConnectedToHallway = room.IsConnectedToHallway;
+		record.CheckCollision = room.CheckCollision;
+		doorPoints.Append(room.DoorPoints);
+	}
+	writer.Write(rooms.Num());
+	writer.WriteBlock(rooms.GetData(), rooms.Num());
+	writer.Write(doorPoints.Num());
+	writer.WriteBlock(doorPoints.GetData(), doorPoints.Num());
+	
+	writer.WriteNested(layout.RoomGroups);
+
+	TArray<int> premadeKeys;
+	TArray<TArray<int>> premadePaths;
+	for(auto& premade : layout.PremadeRooms)
+	{
+		premadeKeys.Add(premade.Key);
+		premadePaths.Add(premade.Value);
+	}
+	writer.Write(premadeKeys.Num());
+	writer.WriteBlock(premadeKeys.GetData(), premadeKeys.Num());
+	writer.WriteNested(premadePaths);
+	
+	writer.Write(layout.RoomLocations.Num());
+	writer.WriteBlock(layout.RoomLocations.GetData(), layout.RoomLocations.Num());
+
+	// hallways
+	writer.WriteNested(layout.HallwayPaths);
+	writer.Write(layout.HallwayCells.Num());
+	writer.WriteBlock(layout.HallwayCells.GetData(), layout.HallwayCells.Num());
+
+	// structures, door positions are the door locations
+	WritePieces(writer, layout.Stairs);
+	WritePieces(writer, layout.Ceilings);
+	WritePieces(writer, layout.Walls);
+	WritePieces(writer, layout.Doors);
+}
+
+/*
+ * @brief Write a layout in the cache format to any file, e.g. layouts baked by a commandlet
+ * @param const FDungeonLayout& layout
+ * @param const FDungeonLayoutCacheKey& key Hash and inputs of the generation parameters
+ * @param const FString& path
+ * @return bool True if the file was written
+ */
+bool FDungeonLayoutCache::SaveToFile(const FDungeonLayout& layout, const FDungeonLayoutCacheKey& key, const FString& path)
+{
+	TArray<uint8> buffer;
+	SaveToBuffer(layout, key, buffer);
+	return DungeonLayoutCache::WriteBuffer(buffer, path);
+}
+
+/*
+ * @brief Read a layout from the cache
+ * @param FDungeonLayout& layout Replaced by the cached layout
+ * @param const FDungeonLayoutCacheKey& key Hash and inputs of the generation parameters
+ * @return bool True on a cache hit, the layout is left in an undefined state on a corrupted file
+ */
+bool FDungeonLayoutCache::Load(FDungeonLayout& layout, const FDungeonLayoutCacheKey& key)
+{
+	using namespace DungeonLayoutCache;
+
+	IPlatformFile& platformFile = FPlatformFileManager::Get().GetPlatformFile();
+	const FString path = GetCachePath(key.Hash);
+	if(!platformFile.FileExists(*path))
+		return false;
+
+	// The region has to be released before the file
+	TUniquePtr<IMappedFileHandle> mappedFile(platformFile.OpenMapped(*path));
+	if(!mappedFile)
+		return false;
+	
+	TUniquePtr<IMappedFileRegion> region(mappedFile->MapRegion(0, mappedFile->GetFileSize()));
+	if(!region)
+		return false;
+
+	return LoadFromMemory(layout, key, region->GetMappedPtr(), region->GetMappedSize());
+}
+
+/*
+ * @brief Read a layout in the cache format from memory
+ * @param FDungeonLayout& layout Replaced by the stored layout
+ * @param const FDungeonLayoutCacheKey& key Hash and inputs of the generation parameters
+ * @param const uint8* data
+ * @param int64 size
+ * @return bool True if the data holds a layout of the key, the layout is left in an undefined state on corrupted data
+ */
+bool FDungeonLayoutCache::LoadFromMemory(FDungeonLayout& layout, const FDungeonLayoutCacheKey& key, const uint8* data, int64 size)
+{
+	using namespace DungeonLayoutCache;
+	
+	FReader reader{ data, size };
+	uint32 magic = 0, version = 0, fileKey = 0;
+	if(!reader.Read(magic) || !reader.Read(version) || !reader.Read(fileKey))
+		return false;
+
+	if(magic != Magic || version != Version || fileKey != key.Hash)
+		return false;
+
+	// Files of other parameters with the same hash are a miss
+	int32 inputCount = 0;
+	TArray<uint8> inputs;
+	if(!reader.Read(inputCount) || !reader.ReadArray(inputs, inputCount) || inputs != key.Inputs)
+		return false;
+
+	// grid
+	FVector gridSize;
+	int unit = 1;
+	FIntVector cellCount;
+	if(!reader.Read(gridSize) || !reader.Read(unit) || !reader.Read(cellCount))
+		return false;
+
+	// The grid divides by the unit, a corrupted header must be a miss and not a crash
+	if(unit <= 0 || gridSize.ContainsNaN() || gridSize.X <= 0 || gridSize.Y <= 0 || gridSize.Z <= 0 || gridSize.GetMax() > MAX_int32)
+		return false;
+	if(cellCount.X <= 0 || cellCount.Y <= 0 || cellCount.Z <= 0 || static_cast<int64>(cellCount.X) * cellCount.Y * cellCount.Z > size)
+		return false;
+
+	layout.Reset(gridSize, unit);
+	if(layout.Grid.GetCellCount() != cellCount)
+		return false;
+	
+	for(int z = 0; z<cellCount.Z; ++z)
+	{
+		for(int y = 0; y<cellCount.Y; ++y)
+		{
+			TArray<EStructureType>& row = layout.Grid.GetRow(y, z);
+			if(!reader.ReadBlock(row.GetData(), row.Num()))
+				return false;
+		}
+	}
+	for(int z = 0; z<cellCount.Z; ++z)
+	{
+		for(int y = 0; y<cellCount.Y; ++y)
+		{
+			TArray<int32>& row = layout.RoomAnchors.GetRow(y, z);
+			if(!reader.ReadBlock(row.GetData(), row.Num()))
+				return false;
+		}
+	}
+
+	// rooms
+	int32 roomCount = 0, doorPointCount = 0;
+	TArray<FCachedRoom> rooms;
+	TArray<FVector> doorPoints;
+	if(!reader.Read(roomCount) || !reader.ReadArray(rooms, roomCount))
+		return false;
+	if(!reader.Read(doorPointCount) || !reader.ReadArray(doorPoints, doorPointCount))
+		return false;
+
+	int doorPointOffset = 0;
+	layout.Rooms.Reserve(roomCount);
+	for(auto& record : rooms)
+	{
+		if(record.DoorPointCount < 0 || doorPointOffset + record.DoorPointCount > doorPoints.Num())
+			return false;
+		
+		FDungeonRoomData& room = layout.Rooms.AddDefaulted_GetRef();
+		room.PrefabType = static_cast<EDungeonPrefabType>(record.PrefabType);
+		room.PrefabIndex = record.PrefabIndex;
+		room.Transform = FromCached(record.Transform);
+		room.Scale = record.Scale;
+		room.Bounds = MakeBox(record.BoundsMin, record.BoundsMax, record.IsBoundsValid);
+		room.DoorPoints.Append(doorPoints.GetData() + doorPointOffset, record.DoorPointCount);
+		room.IsConnectedToHallway = record.IsConnectedToHallway != 0;
+		room.CheckCollision = record.CheckCollision != 0;
+		doorPointOffset += record.DoorPointCount;
+
+		const FBox placementBounds = MakeBox(record.PlacementBoundsMin, record.PlacementBoundsMax, record.IsPlacementBoundsValid);
+		layout.RoomTable.Add(room.Bounds, placementBounds, record.Group, record.Floor, room.PrefabType);
+	}
+	layout.RoomTable.BuildFloorRanges();
+	
+	if(!reader.ReadNested(layout.RoomGroups))
+		return false;
+
+	int32 premadeCount = 0;
+	TArray<int> premadeKeys;
+	TArray<TArray<int>> premadePaths;
+	if(!reader.Read(premadeCount) || !reader.ReadArray(premadeKeys, premadeCount) || !reader.ReadNested(premadePaths))
+		return false;
+	if(premadeKeys.Num() != premadePaths.Num())
+		return false;
+	
+	for(int i = 0; i<premadeKeys.Num(); ++i)
+	{
+		layout.PremadeRooms.Add(premadeKeys[i], MoveTemp(premadePaths[i]));
+	}
+
+	int32 roomLocationCount = 0;
+	if(!reader.Read(roomLocationCount) || !reader.ReadArray(layout.RoomLocations, roomLocationCount))
+		return false;
+
+	// hallways
+	int32 hallwayCellCount = 0;
+	if(!reader.ReadNested(layout.HallwayPaths))
+		return false;
+	if(!reader.Read(hallwayCellCount) || !reader.ReadArray(layout.HallwayCells, hallwayCellCount))
+		return false;
+
+	// structures
+	if(!ReadPieces(reader, layout.Stairs) || !ReadPieces(reader, layout.Ceilings) || !ReadPieces(reader, layout.Walls) || !ReadPieces(reader, layout.Doors))
+		return false;
+
+	for(auto& door : layout.Doors)
+	{
+		layout.DoorPositions.Add(door.Transform.GetLocation());
+	}
+
+	return true;
+}
@@ -0,0 +1,35 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DungeonLayout.h"
+#include "Tasks/Task.h"
+
+// Key of a cached layout, the hash names the file and the inputs are compared on load so a hash collision is a miss
+struct FDungeonLayoutCacheKey
+{
+	uint32 Hash = 0;
+	TArray<uint8> Inputs;
+
+	FDungeonLayoutCacheKey() = default;
+	explicit FDungeonLayoutCacheKey(uint32 hash) : Hash(hash) {}
+};
+
+/**
+ * Versioned binary file of a layout, loaded from a memory mapped file with block copies
+ */
+class NETWORKINGPROTOTYPE_API FDungeonLayoutCache
+{
+public:
+	// Bump when the layout or the file format changes
+	static constexpr uint32 Version = 6;
+	
+	static FString GetCachePath(uint32 key);
+	static bool Save(const FDungeonLayout& layout, const FDungeonLayoutCacheKey& key);
+	static UE::Tasks::FTask SaveAsync(const FDungeonLayout& layout, const FDungeonLayoutCacheKey& key);
+	static bool SaveToFile(const FDungeonLayout& layout, const FDungeonLayoutCacheKey& key, const FString& path);
+	static void SaveToBuffer(const FDungeonLayout& layout, const FDungeonLayoutCacheKey& key, TArray<uint8>& buffer);
+	static bool Load(FDungeonLayout& layout, const FDungeonLayoutCacheKey& key);
+	static bool LoadFromMemory(FDungeonLayout& layout, const FDungeonLayoutCacheKey& key, const uint8* data, int64 size);
+};
@@ -0,0 +1,593 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DungeonMaterializer.h"
+#include "DungeonGenerator.h"
+#include "DungeonGenerationStats.h"
+#include "Components/HierarchicalInstancedStaticMeshComponent.h"
+#include "Algo/Reverse.h"
+
+/*
+ * @brief Default constructor
+ */
+FDungeonMaterializer::FDungeonMaterializer() : generator(nullptr)
+{
+}
+
+/*
+ * @brief Constructor
+ * @param ADungeonGenerator* owner that spawns the actors and owns the prefab lists
+ */
+FDungeonMaterializer::FDungeonMaterializer(ADungeonGenerator* owner) : generator(owner)
+{
+}
+
+/*
+ * @brief Spawn the actors of all rooms and structures in the layout at once
+ * @param const FDungeonLayout& layout
+ */
+void FDungeonMaterializer::Materialize(const FDungeonLayout& layout)
+{
+	BeginMaterialize(layout, TArray<FVector>());
+	SpawnPending(MAX_int32);
+}
+
+/*
+ * @brief Queue the actors of the layout, the closest to the origins are spawned first
+ * Instanced meshes are built right away since they don't spawn actors.
+ * @param const FDungeonLayout& layout Must stay alive until all actors are spawned
+ * @param const TArray<FVector>& priorityOrigins e.g. the entrance and the players
+ */
+void FDungeonMaterializer::BeginMaterialize(const FDungeonLayout& layout, const TArray<FVector>& priorityOrigins)
+{
+	if(!generator)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Materializer has no generator!"));
+		return;
+	}
+
+	// Instanced meshes are components of the generator and aren't replicated, clients only get them by building the layout themselves
+	isInstancing = generator->MaterializeMode == EDungeonMaterializeMode::INSTANCED;
+	if(isInstancing && generator->ReplicationMode == EDungeonReplicationMode::ACTORS && generator->GetNetMode() != NM_Standalone)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Instanced meshes need seed replication, %s spawns actors instead!"), *generator->GetName());
+		isInstancing = false;
+	}
+
+	pendingLayout = &layout;
+	pendingSpawns.Reset();
+	roomActors.SetNumZeroed(layout.Rooms.Num(), EAllowShrinking::No);
+	pendingRooms.Init(false, layout.Rooms.Num());
+
+	// Premade rooms aren't part of the room groups, only their inner paths are
+	for(auto& premade : layout.PremadeRooms)
+	{
+		QueueRoom(layout, premade.Key);
+	}
+	
+	for(auto& roomGroup : layout.RoomGroups)
+	{
+		for(const int roomIndex : roomGroup)
+		{
+			QueueRoom(layout, roomIndex);
+		}
+	}
+
+	for(auto& stair : layout.Stairs)
+	{
+		QueuePiece(stair, true);
+	}
+
+	for(auto& pos : layout.HallwayCells)
+	{
+		QueueBatchedPiece(FDungeonPiece(EDungeonPrefabType::HALLWAY, 0, FTransform(FRotator::ZeroRotator, pos, FVector::OneVector)), true);
+	}
+
+	for(auto& ceiling : layout.Ceilings)
+	{
+		QueueBatchedPiece(ceiling, true);
+	}
+
+	for(auto& wall : layout.Walls)
+	{
+		QueueBatchedPiece(wall, false);
+	}
+
+	FlushInstances();
+
+	// Doors keep their gameplay state on the server, clients get them through replication in seed mode
+	const bool isSeedClient = generator->ReplicationMode == EDungeonReplicationMode::SEED && !generator->HasAuthority();
+	if(!generator->DoorList.IsEmpty() && !isSeedClient)
+	{
+		for(auto& door : layout.Doors)
+		{
+			QueuePiece(door, false);
+		}
+	}
+
+	for(auto& request : pendingSpawns)
+	{
+		request.Priority = 0.0;
+		if(priorityOrigins.IsEmpty())
+			continue;
+		
+		request.Priority = MAX_dbl;
+		for(auto& origin : priorityOrigins)
+		{
+			request.Priority = FMath::Min(request.Priority, FVector::DistSquared(origin, request.Piece.Transform.GetLocation()));
+		}
+	}
+
+	// Rooms that check for collision go first so other structures can't block them, the queue is popped from the back
+	pendingSpawns.StableSort([](const FDungeonSpawnRequest& a, const FDungeonSpawnRequest& b)
+	{
+		if(a.CheckCollision != b.CheckCollision)
+			return a.CheckCollision;
+		return a.Priority < b.Priority;
+	});
+	Algo::Reverse(pendingSpawns);
+}
+
+/*
+ * @brief Spawn the next actors of the queue
+ * @param int maxSpawns Number of actors allowed to spawn
+ * @return int Number of actors spawned
+ */
+int FDungeonMaterializer::SpawnPending(int maxSpawns)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(DungeonGen_SpawnActors);
+
+	int spawned = 0;
+	while(spawned < maxSpawns && !pendingSpawns.IsEmpty())
+	{
+		const FDungeonSpawnRequest request = pendingSpawns.Pop(EAllowShrinking::No);
+		if(request.RoomIndex != INDEX_NONE)
+		{
+			MaterializeRoom(*pendingLayout, request.RoomIndex);
+		}
+		else if(request.Piece.PrefabType == EDungeonPrefabType::DOOR)
+		{
+			MaterializeDoor(request.Piece);
+		}
+		else
+		{
+			MaterializePiece(request.Piece, request.InitInfo);
+		}
+		spawned++;
+	}
+
+	spawnedCount += spawned;
+	if(pendingSpawns.IsEmpty())
+	{
+		pendingLayout = nullptr;
+	}
+	
+	return spawned;
+}
+
+/*
+ * @brief Check if the queued actors are still being spawned
+ * @return bool True until the last queued actor is spawned
+ */
+bool FDungeonMaterializer::IsMaterializing() const
+{
+	return pendingLayout != nullptr;
+}
+
+/*
+ * @brief Get the number of actors waiting to be spawned
+ * @return int
+ */
+int FDungeonMaterializer::GetPendingSpawnCount() const
+{
+	return pendingSpawns.Num();
+}
+
+/*
+ * @brief Get the number of actors spawned since the last reset
+ * @return int
+ */
+int FDungeonMaterializer::GetSpawnedCount() const
+{
+	return spawnedCount;
+}
+
+/*
+ * @brief Spawn the actor of a room and pass the generated info to it
+ * @param const FDungeonLayout& layout
+ * @param int roomIndex Index in the room table
+ * @return AMainRoom* The spawned room
+ */
+AMainRoom* FDungeonMaterializer::MaterializeRoom(const FDungeonLayout& layout, int roomIndex)
+{
+	if(roomActors.Num() < layout.Rooms.Num())
+	{
+		roomActors.SetNumZeroed(layout.Rooms.Num(), EAllowShrinking::No);
+	}
+	if(pendingRooms.IsValidIndex(roomIndex))
+	{
+		pendingRooms[roomIndex] = false;
+	}
+
+	const FDungeonRoomData& room = layout.Rooms[roomIndex];
+	TSubclassOf<AMainRoom> roomClass = generator->GetPrefabClass(room.PrefabType, room.PrefabIndex);
+	if(!roomClass)
+		return nullptr;
+	
+	AMainRoom* roomActor = AcquireStructure(room.Transform, room.PrefabType, roomClass, room.CheckCollision, [&room](AMainRoom* structure)
+	{
+		// Known before BeginPlay of new actors
+		structure->IsConnectedToHallway = room.IsConnectedToHallway;
+		structure->DoorPoints.Reset();
+		for(auto& doorPoint : room.DoorPoints)
+		{
+			structure->AddDoorPoint(doorPoint);
+		}
+	});
+	if(!roomActor)
+		return nullptr;
+
+	roomActor->InitInfo(room.Transform, room.Scale, room.Bounds);
+
+	roomActors[roomIndex] = roomActor;
+	return roomActor;
+}
+
+/*
+ * @brief Park the actors of the previous layout so the next layout can reuse them
+ */
+void FDungeonMaterializer::Reset()
+{
+	for(auto& roomActor : roomActors)
+	{
+		ReleaseActor(roomActor);
+	}
+	for(auto& structureActor : structureActors)
+	{
+		ReleaseActor(structureActor);
+	}
+	for(auto& doorActor : doorActors)
+	{
+		ReleaseActor(doorActor.Value);
+	}
+	
+	roomActors.Reset();
+	structureActors.Reset();
+	doorActors.Reset();
+
+	pendingLayout = nullptr;
+	pendingSpawns.Reset();
+	pendingRooms.Reset();
+	spawnedCount = 0;
+
+	// Instanced meshes belong to the previous layout only
+	for(auto& component : instanceComponents)
+	{
+		if(IsValid(component))
+		{
+			component->DestroyComponent();
+		}
+	}
+	instanceComponents.Empty();
+	pendingInstances.Empty();
+}
+
+/*
+ * @brief Get the actor spawned for a room
+ * @param int roomIndex Index in the room table
+ * @return AMainRoom* The spawned room, null if it wasn't spawned or is still pending
+ */
+AMainRoom* FDungeonMaterializer::GetRoomActor(int roomIndex) const
+{
+	return roomActors.IsValidIndex(roomIndex) ? roomActors[roomIndex] : nullptr;
+}
+
+/*
+ * @brief Check if the actor of a room is queued but not spawned yet
+ * @param int roomIndex Index in the room table
+ * @return bool True while the room is waiting in the spawn queue
+ */
+bool FDungeonMaterializer::IsRoomPending(int roomIndex) const
+{
+	return pendingRooms.IsValidIndex(roomIndex) && pendingRooms[roomIndex];
+}
+
+/*
+ * @brief Spawn the actor of a structure
+ * @param const FDungeonPiece& piece
+ * @param bool initInfo Whether the room info of the actor should be initialized
+ * @return AMainRoom* The spawned structure
+ */
+AMainRoom* FDungeonMaterializer::MaterializePiece(const FDungeonPiece& piece, bool initInfo)
+{
+	TSubclassOf<AMainRoom> pieceClass = generator->GetPrefabClass(piece.PrefabType, piece.PrefabIndex);
+	if(!pieceClass)
+		return nullptr;
+	
+	AMainRoom* spawnedPiece = AcquireStructure(piece.Transform, piece.PrefabType, pieceClass, false, [](AMainRoom*) {});
+	if(!spawnedPiece)
+		return nullptr;
+
+	if(initInfo)
+	{
+		const FBox bounds = piece.Bounds.IsValid ? piece.Bounds : spawnedPiece->GetComponentsBoundingBox();
+		spawnedPiece->InitInfo(piece.Transform, piece.Transform.GetScale3D(), bounds);
+	}
+
+	structureActors.Add(spawnedPiece);
+	return spawnedPiece;
+}
+
+/*
+ * @brief Spawn the actor of a door
+ * @param const FDungeonPiece& piece
+ * @return ABasicDoor* The spawned door
+ */
+ABasicDoor* FDungeonMaterializer::MaterializeDoor(const FDungeonPiece& piece)
+{
+	if(!generator->DoorList.IsValidIndex(piece.PrefabIndex))
+		return nullptr;
+	
+	// Doors aren't pooled, their open and locked state belongs to the round they were spawned in
+	ABasicDoor* spawnedDoor = generator->GetWorld()->SpawnActorDeferred<ABasicDoor>(generator->DoorList[piece.PrefabIndex], piece.Transform);
+	if(!spawnedDoor)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Door class is invalid or null!"));
+		return nullptr;
+	}
+	
+	spawnedDoor->FinishSpawning(piece.Transform);
+	INC_DWORD_STAT(STAT_DungeonGenActorsSpawned);
+	doorActors.Add(piece.Transform.GetLocation(), spawnedDoor);
+	return spawnedDoor;
+}
+
+// ============ Spawn Queue ============
+
+/*
+ * @brief Queue the actor of a room
+ * @param const FDungeonLayout& layout
+ * @param int roomIndex Index in the room table
+ */
+void FDungeonMaterializer::QueueRoom(const FDungeonLayout& layout, int roomIndex)
+{
+	const FDungeonRoomData& room = layout.Rooms[roomIndex];
+	
+	FDungeonSpawnRequest request;
+	request.Piece = FDungeonPiece(room.PrefabType, room.PrefabIndex, room.Transform, room.Bounds);
+	request.RoomIndex = roomIndex;
+	request.CheckCollision = room.CheckCollision;
+	pendingSpawns.Add(request);
+	
+	pendingRooms[roomIndex] = true;
+}
+
+/*
+ * @brief Queue the actor of a structure
+ * @param const FDungeonPiece& piece
+ * @param bool initInfo Whether the room info of the actor should be initialized
+ */
+void FDungeonMaterializer::QueuePiece(const FDungeonPiece& piece, bool initInfo)
+{
+	FDungeonSpawnRequest request;
+	request.Piece = piece;
+	request.InitInfo = initInfo;
+	pendingSpawns.Add(request);
+}
+
+/*
+ * @brief Add a structure to the instanced meshes if possible, queue an actor otherwise
+ * @param const FDungeonPiece& piece
+ * @param bool initInfo Whether the room info of a spawned actor should be initialized
+ */
+void FDungeonMaterializer::QueueBatchedPiece(const FDungeonPiece& piece, bool initInfo)
+{
+	if(isInstancing && InstancePiece(piece))
+		return;
+
+	QueuePiece(piece, initInfo);
+}
+
+// ============ Actor Pool ============
+
+/*
+ * @brief Reuse a parked structure of the class or spawn a new one
+ * New structures are spawned deferred so they are prepared before their construction and BeginPlay.
+ * Replicated structures are always spawned, clients don't see a parked actor move or change its collision.
+ * @param const FTransform& transform
+ * @param EDungeonPrefabType prefabType Role of the structure in the layout
+ * @param TSubclassOf<AMainRoom> structureClass
+ * @param bool checkCollision Whether occupied locations should be skipped
+ * @param TFunctionRef<void(AMainRoom*)> prepare Called before the structure is finished
+ * @return AMainRoom* The structure, null if the location is occupied
+ */
+AMainRoom* FDungeonMaterializer::AcquireStructure(const FTransform& transform, EDungeonPrefabType prefabType, TSubclassOf<AMainRoom> structureClass, bool checkCollision, TFunctionRef<void(AMainRoom*)> prepare)
+{
+	// Parked actors have no collision so they can't occupy the location
+	if(checkCollision && generator->IsLocationOccupied(transform.GetLocation(), transform.GetRotation(), FVector(1.0f, 1.0f, 1.0f)))
+		return nullptr;
+	
+	// Every machine builds its own structures in seed mode
+	const bool shouldReplicate = generator->ReplicationMode == EDungeonReplicationMode::ACTORS;
+	
+	TArray<AMainRoom*>* pool = shouldReplicate ? nullptr : structurePool.Find(FDungeonStructurePoolKey(prefabType, structureClass.Get()));
+	if(pool && !pool->IsEmpty())
+	{
+		// The room information of the previous layout must not leak into this one
+		AMainRoom* structure = pool->Pop(EAllowShrinking::No);
+		structure->ResetInfo();
+		ActivateActor(structure, transform);
+		ApplyRelevancy(structure, transform);
+		prepare(structure);
+		INC_DWORD_STAT(STAT_DungeonGenActorsSpawned);
+		return structure;
+	}
+
+	AMainRoom* structure = generator->GetWorld()->SpawnActorDeferred<AMainRoom>(structureClass, transform);
+	if(!structure)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Room class is invalid or null!"));
+		return nullptr;
+	}
+	
+	structure->SetReplicates(shouldReplicate);
+	ApplyRelevancy(structure, transform);
+	prepare(structure);
+	structure->FinishSpawning(transform);
+	structurePrefabTypes.Add(structure, prefabType);
+	INC_DWORD_STAT(STAT_DungeonGenActorsSpawned);
+	return structure;
+}
+
+/*
+ * @brief Limit the network relevancy of a structure to the floors around it
+ * @param AMainRoom* structure
+ * @param const FTransform& transform
+ */
+void FDungeonMaterializer::ApplyRelevancy(AMainRoom* structure, const FTransform& transform) const
+{
+	// Floors of the dungeon are one unit high
+	const float floorHeight = generator->UseFloorRelevancy ? static_cast<float>(generator->DungeonUnit) : 0.0f;
+	structure->SetFloorRelevancy(transform.GetLocation(), floorHeight, generator->RelevantFloorRange);
+}
+
+/*
+ * @brief Hide a structure and put it back into the pool of its class, doors and replicated structures are destroyed
+ * @param AActor* actor
+ */
+void FDungeonMaterializer::ReleaseActor(AActor* actor)
+{
+	if(!IsValid(actor))
+		return;
+
+	AMainRoom* structure = Cast<AMainRoom>(actor);
+	if(!structure || structure->GetIsReplicated())
+	{
+		if(structure)
+		{
+			structurePrefabTypes.Remove(structure);
+		}
+		actor->Destroy();
+		return;
+	}
+
+	const EDungeonPrefabType* prefabType = structurePrefabTypes.Find(structure);
+	if(!prefabType)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("%s was not spawned by the dungeon and is not pooled"), *structure->GetName());
+		return;
+	}
+
+	actor->SetActorHiddenInGame(true);
+	actor->SetActorEnableCollision(false);
+	actor->SetActorTickEnabled(false);
+	structurePool.FindOrAdd(FDungeonStructurePoolKey(*prefabType, actor->GetClass())).Add(structure);
+}
+
+/*
+ * @brief Move a pooled actor into place and make it visible again
+ * @param AActor* actor
+ * @param const FTransform& transform
+ */
+void FDungeonMaterializer::ActivateActor(AActor* actor, const FTransform& transform)
+{
+	actor->SetActorTransform(transform, false, nullptr, ETeleportType::ResetPhysics);
+	actor->SetActorHiddenInGame(false);
+	// Prefabs can disable their collision by default
+	actor->SetActorEnableCollision(actor->GetClass()->GetDefaultObject<AActor>()->GetActorEnableCollision());
+	actor->SetActorTickEnabled(actor->PrimaryActorTick.bStartWithTickEnabled);
+}
+
+// ============ Instanced Meshes ============
+
+/*
+ * @brief Collect the mesh transforms of a structure into the batch of its chunk
+ * @param const FDungeonPiece& piece
+ * @return bool False if the prefab has to be spawned as an actor
+ */
+bool FDungeonMaterializer::InstancePiece(const FDungeonPiece& piece)
+{
+	TSubclassOf<AMainRoom> pieceClass = generator->GetPrefabClass(piece.PrefabType, piece.PrefabIndex);
+	if(!pieceClass)
+		return false;
+
+	const TArray<const UStaticMeshComponent*>& meshes = GetPrefabMeshes(pieceClass);
+	if(meshes.IsEmpty())
+		return false;
+
+	// Shard the instances by chunk so culling and updates stay local
+	const float chunkSize = FMath::Max(generator->InstanceChunkSize, 1) * generator->DungeonUnit;
+	const FVector location = piece.Transform.GetLocation();
+	const FIntVector chunk = FIntVector(
+		FMath::FloorToInt(location.X / chunkSize),
+		FMath::FloorToInt(location.Y / chunkSize),
+		FMath::FloorToInt(location.Z / chunkSize)
+	);
+
+	for(auto& mesh : meshes)
+	{
+		pendingInstances.FindOrAdd(FDungeonInstanceBatchKey(chunk, mesh)).Add(mesh->GetRelativeTransform() * piece.Transform);
+	}
+
+	return true;
+}
+
+/*
+ * @brief Create one instanced mesh component per batch and add all of its instances at once
+ */
+void FDungeonMaterializer::FlushInstances()
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(DungeonGen_FlushInstances);
+
+	USceneComponent* root = generator->GetRootComponent();
+	
+	for(auto& batch : pendingInstances)
+	{
+		const UStaticMeshComponent* meshTemplate = batch.Key.Value;
+		
+		UHierarchicalInstancedStaticMeshComponent* component = NewObject<UHierarchicalInstancedStaticMeshComponent>(generator);
+		component->SetStaticMesh(meshTemplate->GetStaticMesh());
+		for(int i = 0; i<meshTemplate->GetNumMaterials(); ++i)
+		{
+			component->SetMaterial(i, meshTemplate->GetMaterial(i));
+		}
+		component->SetCollisionProfileName(meshTemplate->GetCollisionProfileName());
+		component->SetMobility(root->Mobility);
+		component->SetupAttachment(root);
+		component->RegisterComponent();
+		generator->AddInstanceComponent(component);
+		
+		component->AddInstances(batch.Value, false, true);
+		instanceComponents.Add(component);
+	}
+
+	pendingInstances.Empty();
+}
+
+/*
+ * @brief Get the static meshes of a prefab
+ * @param TSubclassOf<AMainRoom> prefab
+ * @return const TArray<const UStaticMeshComponent*>& Meshes, empty if the prefab has to stay an actor
+ */
+const TArray<const UStaticMeshComponent*>& FDungeonMaterializer::GetPrefabMeshes(TSubclassOf<AMainRoom> prefab)
+{
+	if(const TArray<const UStaticMeshComponent*>* meshes = prefabMeshes.Find(prefab.Get()))
+		return *meshes;
+
+	TArray<const UStaticMeshComponent*>& meshes = prefabMeshes.Add(prefab.Get());
+	if(prefab->GetDefaultObject<AMainRoom>()->HasGameplayLogic)
+		return meshes;
+
+	// Components added in Blueprint only exist on the class, not on the CDO
+	AActor::ForEachComponentOfActorClassDefault(prefab, UStaticMeshComponent::StaticClass(), [&meshes](const UActorComponent* component)
+	{
+		const UStaticMeshComponent* meshComponent = Cast<UStaticMeshComponent>(component);
+		if(meshComponent && meshComponent->GetStaticMesh())
+		{
+			meshes.Add(meshComponent);
+		}
+		return true;
+	});
+
+	return meshes;
+}
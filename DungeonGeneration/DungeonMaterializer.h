@@ -0,0 +1,97 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DungeonLayout.h"
+
+class ADungeonGenerator;
+class AMainRoom;
+class ABasicDoor;
+class UStaticMeshComponent;
+class UHierarchicalInstancedStaticMeshComponent;
+
+// Instances of one prefab mesh in one chunk
+using FDungeonInstanceBatchKey = TPair<FIntVector, const UStaticMeshComponent*>;
+
+// Parked structures of one role and class, a class used as room and as ceiling has two pools
+using FDungeonStructurePoolKey = TPair<EDungeonPrefabType, UClass*>;
+
+// An actor of the layout waiting to be spawned
+struct FDungeonSpawnRequest
+{
+	FDungeonPiece Piece;
+	int RoomIndex = INDEX_NONE;
+	bool InitInfo = false;
+	bool CheckCollision = false;
+
+	// Lower values are spawned first
+	double Priority = 0.0;
+};
+
+/**
+ * Turns a dungeon layout into actors
+ */
+class NETWORKINGPROTOTYPE_API FDungeonMaterializer
+{
+public:
+	FDungeonMaterializer();
+	FDungeonMaterializer(ADungeonGenerator* owner);
+
+	void Materialize(const FDungeonLayout& layout);
+	AMainRoom* MaterializeRoom(const FDungeonLayout& layout, int roomIndex);
+	void Reset();
+
+	// Spawn queue
+	void BeginMaterialize(const FDungeonLayout& layout, const TArray<FVector>& priorityOrigins);
+	int SpawnPending(int maxSpawns);
+	bool IsMaterializing() const;
+	int GetPendingSpawnCount() const;
+	int GetSpawnedCount() const;
+
+	// Room indices are the handles of room actors, pending rooms have no actor yet
+	AMainRoom* GetRoomActor(int roomIndex) const;
+	bool IsRoomPending(int roomIndex) const;
+
+private:
+	void QueueRoom(const FDungeonLayout& layout, int roomIndex);
+	void QueuePiece(const FDungeonPiece& piece, bool initInfo);
+	void QueueBatchedPiece(const FDungeonPiece& piece, bool initInfo);
+	
+	// Actor pool
+	AMainRoom* AcquireStructure(const FTransform& transform, EDungeonPrefabType prefabType, TSubclassOf<AMainRoom> structureClass, bool checkCollision, TFunctionRef<void(AMainRoom*)> prepare);
+	void ReleaseActor(AActor* actor);
+	void ActivateActor(AActor* actor, const FTransform& transform);
+	void ApplyRelevancy(AMainRoom* structure, const FTransform& transform) const;
+	
+	AMainRoom* MaterializePiece(const FDungeonPiece& piece, bool initInfo);
+	ABasicDoor* MaterializeDoor(const FDungeonPiece& piece);
+
+	// Instanced meshes
+	bool InstancePiece(const FDungeonPiece& piece);
+	void FlushInstances();
+	const TArray<const UStaticMeshComponent*>& GetPrefabMeshes(TSubclassOf<AMainRoom> prefab);
+	
+	ADungeonGenerator* generator = nullptr;
+
+	// Actors of the room table, indexed like the rooms of the layout
+	TArray<AMainRoom*> roomActors;
+	TArray<AMainRoom*> structureActors;
+	TMap<FVector, ABasicDoor*> doorActors;
+
+	// Spawn queue, sorted so the next actor is at the back
+	const FDungeonLayout* pendingLayout = nullptr;
+	TArray<FDungeonSpawnRequest> pendingSpawns;
+	TBitArray<> pendingRooms;
+	int spawnedCount = 0;
+
+	// Parked structures of previous layouts by role and class, only structures that aren't replicated are parked
+	TMap<FDungeonStructurePoolKey, TArray<AMainRoom*>> structurePool;
+	TMap<AMainRoom*, EDungeonPrefabType> structurePrefabTypes;
+
+	// Meshes of the prefabs, empty if the prefab must stay an actor
+	TMap<UClass*, TArray<const UStaticMeshComponent*>> prefabMeshes;
+	TMap<FDungeonInstanceBatchKey, TArray<FTransform>> pendingInstances;
+	bool isInstancing = false;
+	TArray<UHierarchicalInstancedStaticMeshComponent*> instanceComponents;
+};
@@ -0,0 +1,114 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DungeonPathCapture.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+/*
+ * @brief Clear the capture
+ */
+void FDungeonPathCapture::Reset()
+{
+	*this = FDungeonPathCapture();
+}
+
+/*
+ * @brief Record the outcome of the next search
+ * @param const TArray<FVector>& path Result of the search, empty if it failed
+ * @param const FPathfinderQueryStats& query Statistics of the search
+ */
+void FDungeonPathCapture::AddResult(const TArray<FVector>& path, const FPathfinderQueryStats& query)
+{
+	FDungeonPathCaptureResult& result = Results.AddDefaulted_GetRef();
+	result.PathHash = FCrc::MemCrc32(path.GetData(), path.Num() * sizeof(FVector));
+	result.PathLength = path.Num();
+	result.Expansions = query.Expansions;
+	result.Seconds = query.Seconds;
+	result.Found = query.Found;
+}
+
+/*
+ * @brief Read or write the capture, the archive is flagged with an error on a version mismatch
+ * @param FArchive& ar
+ */
+void FDungeonPathCapture::Serialize(FArchive& ar)
+{
+	uint32 magic = Magic;
+	uint32 version = Version;
+	ar << magic;
+	ar << version;
+	if(ar.IsLoading() && (magic != Magic || version != Version))
+	{
+		ar.SetError();
+		return;
+	}
+
+	ar << Seed;
+	ar << LayoutKey;
+	ar << DungeonUnit;
+	ar << DungeonSize;
+	ar << IsDungeonFloorBased;
+	ar << BaseCost;
+	ar << RoomExtraCost;
+	ar << NoneExtraCost;
+	ar << ChangeFloorExtraCost;
+	ar << LayoutSnapshot;
+	ar << Requests;
+	ar << Results;
+}
+
+/*
+ * @brief Write the capture to a file
+ * @param const FString& path
+ * @return bool True if the file was written
+ */
+bool FDungeonPathCapture::Save(const FString& path)
+{
+	TArray<uint8> buffer;
+	FMemoryWriter writer(buffer);
+	Serialize(writer);
+
+	if(!FFileHelper::SaveArrayToFile(buffer, *path))
+	{
+		UE_LOG(LogTemp, Error, TEXT("Failed to write the path capture %s!"), *path);
+		return false;
+	}
+	return true;
+}
+
+/*
+ * @brief Read a capture from a file
+ * @param const FString& path
+ * @return bool True if the file holds a capture of this version
+ */
+bool FDungeonPathCapture::Load(const FString& path)
+{
+	TArray<uint8> buffer;
+	if(!FFileHelper::LoadFileToArray(buffer, *path))
+	{
+		UE_LOG(LogTemp, Error, TEXT("Failed to read the path capture %s!"), *path);
+		return false;
+	}
+
+	Reset();
+	FMemoryReader reader(buffer);
+	Serialize(reader);
+	if(reader.IsError())
+	{
+		UE_LOG(LogTemp, Error, TEXT("%s is not a path capture of version %u!"), *path, Version);
+		return false;
+	}
+	return true;
+}
+
+/*
+ * @brief Get the folder of the captures written by the generator
+ * @return FString
+ */
+FString FDungeonPathCapture::GetCaptureDir()
+{
+	return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("DungeonCapture"));
+}
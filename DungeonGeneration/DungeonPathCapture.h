@@ -0,0 +1,74 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DungeonGraph.h"
+#include "DungeonPathfinderStats.h"
+
+// Outcome of one captured hallway search, compared on replay
+struct FDungeonPathCaptureResult
+{
+	uint32 PathHash = 0;
+	int32 PathLength = 0;
+	int32 Expansions = 0;
+	double Seconds = 0.0;
+	bool Found = false;
+};
+
+/**
+ * Every hallway search of one generation: the layout before routing, the cost parameters and the hallways in routing order
+ * The searches can be replayed without a world to profile the pathfinder on real workloads
+ */
+struct NETWORKINGPROTOTYPE_API FDungeonPathCapture
+{
+	static constexpr uint32 Magic = 0x50414344; // DCAP
+	static constexpr uint32 Version = 1;
+
+	// Generation the searches come from
+	int32 Seed = 0;
+	uint32 LayoutKey = 0;
+
+	// Parameters read by the cost function and the hallway carving
+	int32 DungeonUnit = 1;
+	FVector DungeonSize = FVector::ZeroVector;
+	bool IsDungeonFloorBased = false;
+	float BaseCost = 0.0f;
+	float RoomExtraCost = 0.0f;
+	float NoneExtraCost = 0.0f;
+	float ChangeFloorExtraCost = 0.0f;
+
+	// Layout in the layout cache format
+	TArray<uint8> LayoutSnapshot;
+
+	TArray<FHallwayRequest> Requests;
+	TArray<FDungeonPathCaptureResult> Results;
+
+	void Reset();
+	void AddResult(const TArray<FVector>& path, const FPathfinderQueryStats& query);
+	void Serialize(FArchive& ar);
+
+	bool Save(const FString& path);
+	bool Load(const FString& path);
+
+	// Folder of the captures written by the generator
+	static FString GetCaptureDir();
+};
+
+inline FArchive& operator<<(FArchive& ar, FHallwayRequest& request)
+{
+	ar << request.Edge.Vertex[0];
+	ar << request.Edge.Vertex[1];
+	ar << request.CanChangeFloors;
+	return ar;
+}
+
+inline FArchive& operator<<(FArchive& ar, FDungeonPathCaptureResult& result)
+{
+	ar << result.PathHash;
+	ar << result.PathLength;
+	ar << result.Expansions;
+	ar << result.Seconds;
+	ar << result.Found;
+	return ar;
+}
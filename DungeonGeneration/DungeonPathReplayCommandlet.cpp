@@ -0,0 +1,162 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DungeonPathReplayCommandlet.h"
+#include "DungeonGenerator.h"
+#include "DungeonPathCapture.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+UDungeonPathReplayCommandlet::UDungeonPathReplayCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+/*
+ * @brief Replay every capture and write the timings of each search
+ * @param const FString& Params Command line of the commandlet
+ * @return int32 0 if every capture replayed with the captured paths
+ */
+int32 UDungeonPathReplayCommandlet::Main(const FString& Params)
+{
+	FString capturePath = FDungeonPathCapture::GetCaptureDir();
+	FParse::Value(*Params, TEXT("Capture="), capturePath);
+	FParse::Value(*Params, TEXT("Iterations="), IterationCount);
+	IterationCount = FMath::Max(IterationCount, 1);
+	ShouldAllowChangedPaths = FParse::Param(*Params, TEXT("AllowChangedPaths"));
+
+	FString reportPath;
+	if(!FParse::Value(*Params, TEXT("Output="), reportPath))
+	{
+		reportPath = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("DungeonBatch"), TEXT("DungeonPathReplay.csv"));
+	}
+
+	// A folder replays all of its captures
+	TArray<FString> captureFiles;
+	if(IFileManager::Get().DirectoryExists(*capturePath))
+	{
+		IFileManager::Get().FindFiles(captureFiles, *FPaths::Combine(capturePath, TEXT("*.dpcap")), true, false);
+		captureFiles.Sort();
+		for(auto& file : captureFiles)
+		{
+			file = FPaths::Combine(capturePath, file);
+		}
+	}
+	else
+	{
+		captureFiles.Add(capturePath);
+	}
+
+	if(captureFiles.Num() == 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("No path capture found in %s!"), *capturePath);
+		return 1;
+	}
+
+	Report = TEXT("Capture,Query,StartX,StartY,StartZ,EndX,EndY,EndZ,Found,PathLength,CapturedExpansions,Expansions,CapturedMs,BestMs,MeanMs,SamePath");
+	Report += LINE_TERMINATOR;
+
+	// Only the routing runs, the base class is enough as no prefab is read
+	ADungeonGenerator* generator = NewObject<ADungeonGenerator>(GetTransientPackage(), ADungeonGenerator::StaticClass(), NAME_None, RF_Transient);
+	generator->AddToRoot();
+
+	bool allSucceeded = true;
+	FDungeonPathCapture capture;
+	for(auto& file : captureFiles)
+	{
+		if(!capture.Load(file))
+		{
+			allSucceeded = false;
+			continue;
+		}
+		allSucceeded &= ReplayCapture(generator, FPaths::GetBaseFilename(file), capture);
+	}
+
+	generator->RemoveFromRoot();
+
+	if(!FFileHelper::SaveStringToFile(Report, *reportPath))
+	{
+		UE_LOG(LogTemp, Error, TEXT("Failed to write the replay report %s!"), *reportPath);
+		return 1;
+	}
+	return allSucceeded ? 0 : 1;
+}
+
+/*
+ * @brief Route the hallways of a capture over the iterations and compare the paths with the captured ones
+ * @param ADungeonGenerator* generator
+ * @param const FString& name Name of the capture in the report
+ * @param const FDungeonPathCapture& capture
+ * @return bool False if the capture can't be replayed or a path changed
+ */
+bool UDungeonPathReplayCommandlet::ReplayCapture(ADungeonGenerator* generator, const FString& name, const FDungeonPathCapture& capture)
+{
+	const int queryCount = capture.Requests.Num();
+	TArray<double> bestSeconds;
+	TArray<double> totalSeconds;
+	bestSeconds.Init(MAX_dbl, queryCount);
+	totalSeconds.Init(0.0, queryCount);
+
+	TArray<FDungeonPathCaptureResult> results;
+	for(int i = 0; i<IterationCount; ++i)
+	{
+		if(!generator->ReplayPathCapture(capture))
+			return false;
+
+		results = generator->GetPathCapture().Results;
+		if(results.Num() != queryCount)
+		{
+			UE_LOG(LogTemp, Error, TEXT("%s: %d of %d searches were replayed!"), *name, results.Num(), queryCount);
+			return false;
+		}
+
+		for(int query = 0; query<queryCount; ++query)
+		{
+			bestSeconds[query] = FMath::Min(bestSeconds[query], results[query].Seconds);
+			totalSeconds[query] += results[query].Seconds;
+		}
+	}
+
+	double capturedTotal = 0.0;
+	double bestTotal = 0.0;
+	int changedCount = 0;
+	for(int query = 0; query<queryCount; ++query)
+	{
+		const FHallwayRequest& request = capture.Requests[query];
+		const FDungeonPathCaptureResult& result = results[query];
+
+		// Searches after a changed path run on different cells, only the first change is meaningful
+		const bool hasCapturedResult = capture.Results.IsValidIndex(query);
+		const bool samePath = !hasCapturedResult
+			|| (capture.Results[query].PathHash == result.PathHash && capture.Results[query].PathLength == result.PathLength);
+		if(!samePath)
+		{
+			if(changedCount == 0)
+			{
+				UE_LOG(LogTemp, Warning, TEXT("%s: search %d from %s to %s found a different path than the capture"),
+					*name, query, *request.Edge.Vertex[0].ToString(), *request.Edge.Vertex[1].ToString());
+			}
+			changedCount++;
+		}
+
+		const int capturedExpansions = hasCapturedResult ? capture.Results[query].Expansions : 0;
+		const double capturedSeconds = hasCapturedResult ? capture.Results[query].Seconds : 0.0;
+		capturedTotal += capturedSeconds;
+		bestTotal += bestSeconds[query];
+
+		Report += FString::Printf(TEXT("%s,%d,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f,%d,%d,%d,%d,%.4f,%.4f,%.4f,%d"), *name, query,
+			request.Edge.Vertex[0].X, request.Edge.Vertex[0].Y, request.Edge.Vertex[0].Z,
+			request.Edge.Vertex[1].X, request.Edge.Vertex[1].Y, request.Edge.Vertex[1].Z,
+			result.Found ? 1 : 0, result.PathLength, capturedExpansions, result.Expansions,
+			capturedSeconds * 1000.0, bestSeconds[query] * 1000.0, totalSeconds[query] * 1000.0 / IterationCount, samePath ? 1 : 0);
+		Report += LINE_TERMINATOR;
+	}
+
+	UE_LOG(LogTemp, Display, TEXT("%s: %d searches, captured %.3f ms, replay best %.3f ms, %d changed paths"),
+		*name, queryCount, capturedTotal * 1000.0, bestTotal * 1000.0, changedCount);
+	generator->GetPathfinderStats().LogSummary();
+
+	return changedCount == 0 || ShouldAllowChangedPaths;
+}
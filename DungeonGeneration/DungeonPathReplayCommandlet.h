@@ -0,0 +1,35 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "DungeonPathReplayCommandlet.generated.h"
+
+class ADungeonGenerator;
+struct FDungeonPathCapture;
+
+/**
+ * Replays the hallway searches captured by generators with CaptureHallwaySearches, no world or assets are needed
+ * Paths that differ from the capture fail the run unless -AllowChangedPaths is passed
+ *
+ * UnrealEditor-Cmd <Project> -run=DungeonPathReplay -nullrhi -Capture=<File or Dir> -Iterations=5 -Output=<Csv>
+ */
+UCLASS()
+class NETWORKINGPROTOTYPE_API UDungeonPathReplayCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UDungeonPathReplayCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+private:
+	// Replay one capture over the iterations, returns false if it can't be replayed or a path changed
+	bool ReplayCapture(ADungeonGenerator* generator, const FString& name, const FDungeonPathCapture& capture);
+
+	int IterationCount = 5;
+	bool ShouldAllowChangedPaths = false;
+	FString Report;
+};
@@ -2,7 +2,8 @@
 
 
 #include "DungeonPathfinder3D.h"
-#include "Windows/AllowWindowsPlatformTypes.h"
+#include "DungeonGenerationStats.h"
+#include "Misc/ScopeExit.h"
 
 /*
  * @brief Default constructor
@@ -54,6 +55,41 @@ DungeonPathfinder3D::DungeonPathfinder3D(const FVector& size, const int& unitSiz
 	}
 }
 
+/*
+ * @brief Resize the grid for a new dungeon and drop any suspended search, the nodes and containers keep their memory
+ * @param size of the grid
+ * @param newUnitSize
+ */
+void DungeonPathfinder3D::Reset(const FVector& size, const int& newUnitSize)
+{
+	// Nodes are reset at the start of every search, only their positions depend on the size
+	if(grid.GetSize() != size || unitSize != newUnitSize)
+	{
+		unitSize = newUnitSize;
+		grid.Reset(size, unitSize, unitSize);
+
+		for (int x = 0; x < size.X; x+=unitSize)
+		{
+			for (int y = 0; y < size.Y; y+=unitSize)
+			{
+				for (int z = 0; z < size.Z; z+=unitSize)
+				{
+					grid[FVector(x, y, z)].Position = FVector(x, y, z);
+				}
+			}
+		}
+	}
+
+	queue.Reset();
+	closedNodes.Reset();
+	stack.Reset();
+	searchStatus = EPathSearchStatus::IDLE;
+	searchEnd = FVector::ZeroVector;
+	searchCostFunction = nullptr;
+	searchDirections.Reset();
+	searchResult.Reset();
+}
+
 /*
  * @brief Find the path from the start to the target point
  * @param start point
@@ -68,57 +104,120 @@ TArray<FVector> DungeonPathfinder3D::FindPath(const FVector& start, const FVecto
 }
 TArray<FVector> DungeonPathfinder3D::FindPath(const FVector& start, const FVector& end,
 	const std::function<DungeonPathInfo(DungeonNode, DungeonNode)>& costFunction, bool canChangeFloors)
+{
+	BeginSearch(start, end, costFunction, canChangeFloors);
+	StepSearch(MAX_int32);
+
+	return searchResult;
+}
+
+/*
+ * @brief Start a resumable search from the start to the target point
+ * @param start point
+ * @param end point
+ * @param costFunction to calculate the cost of the path, it is kept until the search is done
+ * @param canChangeFloors whether the path can use stairs
+ */
+void DungeonPathfinder3D::BeginSearch(const FVector& start, const FVector& end,
+	const std::function<DungeonPathInfo(DungeonNode, DungeonNode)>& costFunction, bool canChangeFloors)
 {
 	ResetNodes();
-	queue.Empty();
-	closedNodes.Empty();
+	queue.Reset();
+	closedNodes.Reset();
+	searchResult.Reset();
+	searchDirections.Reset();
+
+	queryStats = FPathfinderQueryStats();
+	queryStats.Start = start;
+	queryStats.End = end;
 
+	// Nothing to route, the empty path is a result and not an error
 	if(start == end)
-		return TArray<FVector>();
+	{
+		searchStatus = EPathSearchStatus::FOUND;
+		FinishQuery();
+		return;
+	}
+
+	searchEnd = end;
+	searchCostFunction = costFunction;
+	searchStatus = EPathSearchStatus::RUNNING;
 
 	grid[start].Cost = 0;
 	queue.Push(grid[start]);
+	queryStats.Pushes = 1;
+	queryStats.PeakOpenCount = 1;
 
 	// Adjust the directions based on the unit size
-	TArray<FVector> adjustDirections;
 	if(!canChangeFloors)
 	{
 		for(auto& offset : Directions2D)
 		{
-			adjustDirections.Add(offset * unitSize);
+			searchDirections.Add(offset * unitSize);
 		}
 	}
 	else
 	{
 		for(auto& offset : Directions)
 		{
-			adjustDirections.Add(offset * unitSize);
+			searchDirections.Add(offset * unitSize);
 		}
 	}
+}
 
-	int loopCount = 0;
-	while(queue.Num() > 0)
+/*
+ * @brief Continue the current search
+ * @param maxExpansions number of nodes to expand before yielding
+ * @return EPathSearchStatus RUNNING if the search yielded, FOUND or FAILED once it is done
+ */
+EPathSearchStatus DungeonPathfinder3D::StepSearch(int maxExpansions)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(DungeonGen_FindPath);
+
+	if(searchStatus != EPathSearchStatus::RUNNING)
+		return searchStatus;
+
+	const double stepStartTime = FPlatformTime::Seconds();
+	int expansions = 0;
+	ON_SCOPE_EXIT
 	{
-		loopCount++;
+		INC_DWORD_STAT_BY(STAT_DungeonGenNodesExpanded, expansions);
+		queryStats.Expansions += expansions;
+		queryStats.Seconds += FPlatformTime::Seconds() - stepStartTime;
 
-		// if(loopCount >= 1000)
-		// {
-		// 	break;
-		// }
+		if(searchStatus != EPathSearchStatus::RUNNING)
+			FinishQuery();
+	};
+	
+	while(queue.Num() > 0)
+	{
+		if(expansions >= maxExpansions)
+		{
+			return searchStatus;
+		}
+		
+		expansions++;
 		
 		DungeonNode tmp = queue.Pop();
 		DungeonNode* node = &grid[tmp.Position];
+
+		// The node was pushed again with a lower cost after this entry
+		if(tmp.Cost > node->Cost)
+			queryStats.StalePops++;
 		
 		closedNodes.Add(node);
 
 		// Reverse the node linked list to get the path
-		if(node->Position == end)
+		if(node->Position == searchEnd)
 		{
-			return ReconstructPath(node);
+			searchResult = ReconstructPath(node);
+			searchStatus = EPathSearchStatus::FOUND;
+			searchCostFunction = nullptr;
+			return searchStatus;
 		}
 
 		// Find the neighbors and update the node
-		for(auto& offset : adjustDirections)
+		for(auto& offset : searchDirections)
 		{
 			// Check if the node is within the bounds
 			if(!grid.InBounds(node->Position + offset)) continue;
@@ -131,7 +230,7 @@ TArray<FVector> DungeonPathfinder3D::FindPath(const FVector& start, const FVecto
 			if(node->PreviousSet.Contains(nb->Position)) continue;
 
 			// Check if the path is traversable
-			DungeonPathInfo pathInfo = costFunction(*node, *nb);
+			DungeonPathInfo pathInfo = searchCostFunction(*node, *nb);
 			if(!pathInfo.Traversable) continue;
 
 			if(pathInfo.IsStairs)
@@ -159,6 +258,8 @@ TArray<FVector> DungeonPathfinder3D::FindPath(const FVector& start, const FVecto
 				nb->Cost = newCost;
 
 				queue.Push(*nb);
+				queryStats.Pushes++;
+				queryStats.PeakOpenCount = FMath::Max(queryStats.PeakOpenCount, queue.Num());
 				
 				// Update the previous set
 				nb->PreviousSet.Empty();
@@ -182,7 +283,27 @@ TArray<FVector> DungeonPathfinder3D::FindPath(const FVector& start, const FVecto
 		}
 	}
 
-	return TArray<FVector>();
+	searchStatus = EPathSearchStatus::FAILED;
+	searchCostFunction = nullptr;
+	return searchStatus;
+}
+
+/*
+ * @brief Get the status of the current search
+ * @return EPathSearchStatus status
+ */
+EPathSearchStatus DungeonPathfinder3D::GetSearchStatus() const
+{
+	return searchStatus;
+}
+
+/*
+ * @brief Get the path of the last finished search
+ * @return const TArray<FVector>& path, empty if no path was found
+ */
+const TArray<FVector>& DungeonPathfinder3D::GetSearchResult() const
+{
+	return searchResult;
 }
 
 /*
@@ -238,8 +359,80 @@ TArray<FVector> DungeonPathfinder3D::GetNebighors2D(const FVector& pos)
 	return result;
 }
 
+/*
+ * @brief Clear the statistics, e.g. when a new generation starts
+ * @param slowQueryCapacity number of slowest queries to keep, 0 keeps none
+ */
+void DungeonPathfinder3D::ResetStats(int slowQueryCapacity)
+{
+	stats.Reset(slowQueryCapacity);
+}
+
+/*
+ * @brief Get the statistics of the searches since the last reset
+ * @return const FPathfinderStats& stats
+ */
+const FPathfinderStats& DungeonPathfinder3D::GetStats() const
+{
+	return stats;
+}
+
+/*
+ * @brief Get the statistics of the current or last search
+ * @return const FPathfinderQueryStats&
+ */
+const FPathfinderQueryStats& DungeonPathfinder3D::GetLastQueryStats() const
+{
+	return queryStats;
+}
+
+/*
+ * @brief Get the memory used by the nodes and the search
+ * @return SIZE_T bytes
+ */
+SIZE_T DungeonPathfinder3D::GetAllocatedSize() const
+{
+	SIZE_T bytes = grid.GetAllocatedSize();
+
+	// Every node keeps the cells of its path
+	const FIntVector cellCount = grid.GetCellCount();
+	for(int z = 0; z<cellCount.Z; ++z)
+	{
+		for(int y = 0; y<cellCount.Y; ++y)
+		{
+			for(auto& node : grid.GetRow(y, z))
+			{
+				bytes += node.PreviousSet.GetAllocatedSize();
+			}
+		}
+	}
+	
+	bytes += queue.GetAllocatedSize();
+	bytes += closedNodes.GetAllocatedSize();
+	bytes += stack.GetAllocatedSize();
+	bytes += searchDirections.GetAllocatedSize();
+	bytes += searchResult.GetAllocatedSize();
+	return bytes;
+}
+
 // ============ Helper Functions ============
 
+/*
+ * @brief Add the finished search to the statistics
+ */
+void DungeonPathfinder3D::FinishQuery()
+{
+	queryStats.Found = searchStatus == EPathSearchStatus::FOUND;
+	queryStats.PathLength = searchResult.Num();
+	for(int i = 1; i<searchResult.Num(); ++i)
+	{
+		if(searchResult[i].Z != searchResult[i-1].Z)
+			queryStats.StairTransitions++;
+	}
+	
+	stats.AddQuery(queryStats);
+}
+
 /*
  * @brief Reset the nodes for the pathfinding
  */
@@ -256,7 +449,7 @@ void DungeonPathfinder3D::ResetNodes()
 				FVector index = FVector(x, y, z);
 				grid[index].Previous = nullptr;
 				grid[index].Cost = MAX_flt;
-				grid[index].PreviousSet.Empty();
+				grid[index].PreviousSet.Reset();
 			}
 		}
 	}
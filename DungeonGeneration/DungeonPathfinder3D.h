@@ -3,8 +3,9 @@
 #pragma once
 
 #include "CoreMinimal.h"
-#include "NetworkingPrototype/DungeonGeneration/Grid3D.h"
-#include "NetworkingPrototype/DungeonGeneration/TPriorityQueue.h"
+#include "Grid3D.h"
+#include "TPriorityQueue.h"
+#include "DungeonPathfinderStats.h"
 #include <functional>
 
 // Node for the dungeon pathfinding
@@ -52,6 +53,15 @@ public:
 	bool IsStairs = false;
 };
 
+// State of a resumable path search
+enum class EPathSearchStatus : uint8
+{
+	IDLE,
+	RUNNING,
+	FOUND,
+	FAILED
+};
+
 // Offset for the all directions from a node in 3D space
 static const FVector Directions[] =
 {
@@ -93,13 +103,31 @@ public:
 	DungeonPathfinder3D();
 	DungeonPathfinder3D(const FVector& size, const int& unitSize);
 
+	// Resize the nodes for a new dungeon, the memory of the previous one is reused
+	void Reset(const FVector& size, const int& newUnitSize);
+
 	TArray<FVector> FindPath(const FVector& start, const FVector& end, const std::function<DungeonPathInfo(DungeonNode, DungeonNode)>& costFunction);
 	TArray<FVector> FindPath(const FVector& start, const FVector& end, const std::function<DungeonPathInfo(DungeonNode, DungeonNode)>& costFunction, bool canChangeFloors);
 	TArray<FVector> GetNebighors(const FVector& pos);
 	TArray<FVector> GetNebighors2D(const FVector& pos);
 
+	// Resumable search, the search can yield after a number of expansions and continue later
+	void BeginSearch(const FVector& start, const FVector& end, const std::function<DungeonPathInfo(DungeonNode, DungeonNode)>& costFunction, bool canChangeFloors);
+	EPathSearchStatus StepSearch(int maxExpansions);
+	EPathSearchStatus GetSearchStatus() const;
+	const TArray<FVector>& GetSearchResult() const;
+
+	// Statistics of every finished search
+	void ResetStats(int slowQueryCapacity = 0);
+	const FPathfinderStats& GetStats() const;
+	const FPathfinderQueryStats& GetLastQueryStats() const;
+
+	// Memory used by the nodes and the search
+	SIZE_T GetAllocatedSize() const;
+
 private:
 	void ResetNodes();
+	void FinishQuery();
 	TArray<FVector> ReconstructPath(DungeonNode* node);
 	
 	Grid3D<DungeonNode> grid;
@@ -109,4 +137,15 @@ private:
 	TPriorityQueue<DungeonNode> queue;
 	
 	TArray<DungeonNode*> closedNodes;
+
+	// Suspended search state
+	EPathSearchStatus searchStatus = EPathSearchStatus::IDLE;
+	FVector searchEnd = FVector::ZeroVector;
+	std::function<DungeonPathInfo(DungeonNode, DungeonNode)> searchCostFunction;
+	TArray<FVector> searchDirections;
+	TArray<FVector> searchResult;
+
+	// Statistics
+	FPathfinderQueryStats queryStats;
+	FPathfinderStats stats;
 };
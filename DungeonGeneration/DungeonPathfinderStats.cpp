@@ -0,0 +1,178 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DungeonPathfinderStats.h"
+
+// ============ Histogram ============
+
+/*
+ * @brief Add a value to its bucket
+ * @param double value
+ */
+void FPathfinderHistogram::Add(double value)
+{
+	const int bucket = value < 1.0 ? 0 : FMath::FloorLog2_64(static_cast<uint64>(value)) + 1;
+	Buckets[FMath::Min(bucket, BucketCount - 1)]++;
+
+	Count++;
+	Sum += value;
+	Max = FMath::Max(Max, value);
+}
+
+/*
+ * @brief Clear every bucket
+ */
+void FPathfinderHistogram::Reset()
+{
+	FMemory::Memzero(Buckets);
+	Count = 0;
+	Sum = 0.0;
+	Max = 0.0;
+}
+
+/*
+ * @brief Get the mean of the added values
+ * @return double
+ */
+double FPathfinderHistogram::GetMean() const
+{
+	return Count > 0 ? Sum / Count : 0.0;
+}
+
+/*
+ * @brief Get the smallest value of a bucket
+ * @param int bucket
+ * @return double
+ */
+double FPathfinderHistogram::GetBucketMin(int bucket) const
+{
+	return bucket == 0 ? 0.0 : static_cast<double>(1ull << (bucket - 1));
+}
+
+/*
+ * @brief Format the non empty buckets
+ * @return FString e.g. "mean 12.5 max 80 | 8+: 3 16+: 5 64+: 1"
+ */
+FString FPathfinderHistogram::ToString() const
+{
+	FString result = FString::Printf(TEXT("mean %.1f max %.0f |"), GetMean(), Max);
+	for(int i = 0; i<BucketCount; ++i)
+	{
+		if(Buckets[i] > 0)
+		{
+			result += FString::Printf(TEXT(" %.0f+: %d"), GetBucketMin(i), Buckets[i]);
+		}
+	}
+	return result;
+}
+
+// ============ Pathfinder Stats ============
+
+/*
+ * @brief Clear the statistics for a new generation
+ * @param int slowQueryCapacity Number of slowest queries to keep
+ */
+void FPathfinderStats::Reset(int slowQueryCapacity)
+{
+	Expansions.Reset();
+	Pushes.Reset();
+	StalePops.Reset();
+	PeakOpenCount.Reset();
+	PathLength.Reset();
+	StairTransitions.Reset();
+	Microseconds.Reset();
+
+	failedQueryCount = 0;
+	slowestCapacity = FMath::Max(slowQueryCapacity, 0);
+	slowestQueries.Reset(slowestCapacity);
+}
+
+/*
+ * @brief Add a finished search
+ * @param const FPathfinderQueryStats& query
+ */
+void FPathfinderStats::AddQuery(const FPathfinderQueryStats& query)
+{
+	Expansions.Add(query.Expansions);
+	Pushes.Add(query.Pushes);
+	StalePops.Add(query.StalePops);
+	PeakOpenCount.Add(query.PeakOpenCount);
+	PathLength.Add(query.PathLength);
+	StairTransitions.Add(query.StairTransitions);
+	Microseconds.Add(query.Seconds * 1000000.0);
+
+	if(!query.Found)
+		failedQueryCount++;
+
+	if(slowestCapacity <= 0)
+		return;
+
+	if(slowestQueries.Num() < slowestCapacity)
+	{
+		slowestQueries.Add(query);
+		return;
+	}
+
+	// Replace the fastest of the kept queries
+	int fastestIndex = 0;
+	for(int i = 1; i<slowestQueries.Num(); ++i)
+	{
+		if(slowestQueries[i].Seconds < slowestQueries[fastestIndex].Seconds)
+			fastestIndex = i;
+	}
+	if(query.Seconds > slowestQueries[fastestIndex].Seconds)
+	{
+		slowestQueries[fastestIndex] = query;
+	}
+}
+
+/*
+ * @brief Get the number of searches since the last reset
+ * @return int
+ */
+int FPathfinderStats::GetQueryCount() const
+{
+	return Expansions.Count;
+}
+
+/*
+ * @brief Get the number of searches that found no path
+ * @return int
+ */
+int FPathfinderStats::GetFailedQueryCount() const
+{
+	return failedQueryCount;
+}
+
+/*
+ * @brief Get the slowest searches, unordered
+ * @return const TArray<FPathfinderQueryStats>&
+ */
+const TArray<FPathfinderQueryStats>& FPathfinderStats::GetSlowestQueries() const
+{
+	return slowestQueries;
+}
+
+/*
+ * @brief Write the histograms and the slowest queries to the log
+ */
+void FPathfinderStats::LogSummary() const
+{
+	UE_LOG(LogTemp, Log, TEXT("Pathfinder: %d queries, %d failed"), GetQueryCount(), failedQueryCount);
+	UE_LOG(LogTemp, Log, TEXT("  Expansions: %s"), *Expansions.ToString());
+	UE_LOG(LogTemp, Log, TEXT("  Pushes: %s"), *Pushes.ToString());
+	UE_LOG(LogTemp, Log, TEXT("  Stale pops: %s"), *StalePops.ToString());
+	UE_LOG(LogTemp, Log, TEXT("  Peak open list: %s"), *PeakOpenCount.ToString());
+	UE_LOG(LogTemp, Log, TEXT("  Path length: %s"), *PathLength.ToString());
+	UE_LOG(LogTemp, Log, TEXT("  Stair transitions: %s"), *StairTransitions.ToString());
+	UE_LOG(LogTemp, Log, TEXT("  Microseconds: %s"), *Microseconds.ToString());
+
+	TArray<FPathfinderQueryStats> slowest = slowestQueries;
+	slowest.Sort([](const FPathfinderQueryStats& a, const FPathfinderQueryStats& b) { return a.Seconds > b.Seconds; });
+	for(auto& query : slowest)
+	{
+		UE_LOG(LogTemp, Log, TEXT("  Slow query %.3f ms: %s -> %s, %d expansions, %s"),
+			query.Seconds * 1000.0, *query.Start.ToString(), *query.End.ToString(), query.Expansions,
+			query.Found ? TEXT("found") : TEXT("failed"));
+	}
+}
@@ -0,0 +1,71 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+// Counters of one path search
+struct FPathfinderQueryStats
+{
+	FVector Start = FVector::ZeroVector;
+	FVector End = FVector::ZeroVector;
+	bool Found = false;
+
+	int Expansions = 0;
+	int Pushes = 0;
+	int StalePops = 0;
+	int PeakOpenCount = 0;
+	int PathLength = 0;
+	int StairTransitions = 0;
+
+	// Time spent in the search, yields of a resumable search are not counted
+	double Seconds = 0.0;
+};
+
+// Values in power of two buckets, bucket 0 holds values below 1
+struct NETWORKINGPROTOTYPE_API FPathfinderHistogram
+{
+	static constexpr int BucketCount = 32;
+
+	void Add(double value);
+	void Reset();
+	double GetMean() const;
+	double GetBucketMin(int bucket) const;
+	FString ToString() const;
+
+	int Buckets[BucketCount] = {};
+	int Count = 0;
+	double Sum = 0.0;
+	double Max = 0.0;
+};
+
+/**
+ * Statistics of every search of a generation, used to tune the hallway costs
+ */
+class NETWORKINGPROTOTYPE_API FPathfinderStats
+{
+public:
+	// Keep the slowest queries with their endpoints, 0 disables the buffer
+	void Reset(int slowQueryCapacity = 0);
+	void AddQuery(const FPathfinderQueryStats& query);
+
+	int GetQueryCount() const;
+	int GetFailedQueryCount() const;
+	const TArray<FPathfinderQueryStats>& GetSlowestQueries() const;
+	void LogSummary() const;
+
+	FPathfinderHistogram Expansions;
+	FPathfinderHistogram Pushes;
+	FPathfinderHistogram StalePops;
+	FPathfinderHistogram PeakOpenCount;
+	FPathfinderHistogram PathLength;
+	FPathfinderHistogram StairTransitions;
+	FPathfinderHistogram Microseconds;
+
+private:
+	int failedQueryCount = 0;
+	int slowestCapacity = 0;
+
+	// Full buffer replaces its fastest entry
+	TArray<FPathfinderQueryStats> slowestQueries;
+};
@@ -14,11 +14,19 @@ public:
 	Grid3D();
 	Grid3D(const FVector& size, const float& borderOffset, const int& m_unit);
 	T& operator[](const FVector& pos);
+	const T& operator[](const FVector& pos) const;
+
+	void Reset(const FVector& size, const float& borderOffset, const int& m_unit);
 
 	bool InBounds(const FVector& pos) const;
 	bool InBoundsIgnoreOffset(const FVector& pos) const;
 	FVector GetIndex(const FVector& pos) const;
 	FVector GetSize() const;
+	FIntVector GetCellCount() const;
+	int GetUnit() const;
+	TArray<T>& GetRow(int y, int z);
+	const TArray<T>& GetRow(int y, int z) const;
+	SIZE_T GetAllocatedSize() const;
 
 private:
 	FVector size;
@@ -77,6 +85,45 @@ Grid3D<T>::Grid3D(const FVector& m_size, const float& borderOffset, const int& m
 	}
 }
 
+/*
+ * @brief Resize the grid and set every cell to its default value, the memory is reused if the size allows it
+ * @param FVector size
+ * @param float borderOffset
+ * @param int unit
+ */
+template <class T>
+void Grid3D<T>::Reset(const FVector& m_size, const float& m_borderOffset, const int& m_unit)
+{
+	if(m_size.X <= 0 || m_size.Y<=0 || m_size.Z<=0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("BRUH why the size is 0 or negative!?"));
+		return;
+	}
+
+	size = m_size;
+	unit = m_unit;
+	borderOffset = m_borderOffset;
+	
+	int depth = FMath::RoundToInt(size.Z+ 1) / m_unit;
+	int rows = FMath::RoundToInt(size.Y+ 1) / m_unit;
+	int columns = FMath::RoundToInt(size.X+ 1) / m_unit;
+
+	data.SetNum(depth, EAllowShrinking::No);
+	for (int32 Z = 0; Z < depth; ++Z)
+	{
+		data[Z].SetNum(rows, EAllowShrinking::No);
+    
+		for (int32 Y = 0; Y < rows; ++Y)
+		{
+			data[Z][Y].SetNum(columns, EAllowShrinking::No);
+			for (int32 X = 0; X < columns; ++X)
+			{
+				data[Z][Y][X] = T();
+			}
+		}
+	}
+}
+
 // Bracket operator
 template <class T>
 T& Grid3D<T>::operator[](const FVector& pos)
@@ -85,6 +132,13 @@ T& Grid3D<T>::operator[](const FVector& pos)
 	return data[index.Z][index.Y][index.X];
 }
 
+template <class T>
+const T& Grid3D<T>::operator[](const FVector& pos) const
+{
+	FVector index = GetIndex(pos);
+	return data[index.Z][index.Y][index.X];
+}
+
 /*
  * @brief Check if a position is within the bounds of the 3D grid
  * @param FVector position
@@ -136,3 +190,63 @@ FVector Grid3D<T>::GetSize() const
 {
 	return size;
 }
+
+/*
+ *	@brief Get the number of cells along each axis
+ *	@return FIntVector cell count
+ */
+template <class T>
+FIntVector Grid3D<T>::GetCellCount() const
+{
+	const int depth = data.Num();
+	const int rows = depth > 0 ? data[0].Num() : 0;
+	const int columns = rows > 0 ? data[0][0].Num() : 0;
+	return FIntVector(columns, rows, depth);
+}
+
+/*
+ *	@brief Get a row of cells along X, rows are contiguous in memory
+ *	@param int y index
+ *	@param int z index
+ *	@return TArray<T>& row
+ */
+template <class T>
+TArray<T>& Grid3D<T>::GetRow(int y, int z)
+{
+	return data[z][y];
+}
+
+template <class T>
+const TArray<T>& Grid3D<T>::GetRow(int y, int z) const
+{
+	return data[z][y];
+}
+
+/*
+ *	@brief Get the memory used by the cells, memory owned by the cells themselves is not included
+ *	@return SIZE_T bytes
+ */
+template <class T>
+SIZE_T Grid3D<T>::GetAllocatedSize() const
+{
+	SIZE_T bytes = data.GetAllocatedSize();
+	for(auto& plane : data)
+	{
+		bytes += plane.GetAllocatedSize();
+		for(auto& row : plane)
+		{
+			bytes += row.GetAllocatedSize();
+		}
+	}
+	return bytes;
+}
+
+/*
+ *	@brief Get the size of a cell
+ *	@return int unit
+ */
+template <class T>
+int Grid3D<T>::GetUnit() const
+{
+	return unit;
+}
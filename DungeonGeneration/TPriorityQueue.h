@@ -20,8 +20,11 @@ public:
 	T Pop();
 	void Push(T item);
 	void Empty();
+	// Remove every item but keep the memory for the next search
+	void Reset();
 	bool IsEmpty() const;
 	int32 Num() const;
+	SIZE_T GetAllocatedSize() const;
 
 private:
 	TArray<T> Heap;
@@ -53,6 +56,12 @@ void TPriorityQueue<T>::Empty()
 	Heap.Empty();
 }
 
+template <class T>
+void TPriorityQueue<T>::Reset()
+{
+	Heap.Reset();
+}
+
 template <class T>
 bool TPriorityQueue<T>::IsEmpty() const
 {
@@ -64,3 +73,9 @@ int32 TPriorityQueue<T>::Num() const
 {
 	return Heap.Num();
 }
+
+template <class T>
+SIZE_T TPriorityQueue<T>::GetAllocatedSize() const
+{
+	return Heap.GetAllocatedSize();
+}
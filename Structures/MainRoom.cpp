@@ -117,7 +117,74 @@ void AMainRoom::InitInfo(const FTransform& transform, const FVector& scale, cons
 
 	if(RoomRoot)
 	{
+		if(!hasDefaultRootScale)
+		{
+			defaultRootScale = RoomRoot->GetRelativeScale3D();
+			hasDefaultRootScale = true;
+		}
 		RoomRoot->SetWorldScale3D(scale);
 	}
 }
 
+/*
+ * @brief Restore the room information of the class defaults
+ */
+void AMainRoom::ResetInfo()
+{
+	const AMainRoom* defaultRoom = GetClass()->GetDefaultObject<AMainRoom>();
+	Transform = defaultRoom->Transform;
+	Scale = defaultRoom->Scale;
+	Bounds = defaultRoom->Bounds;
+	DoorPoints = defaultRoom->DoorPoints;
+	IsConnectedToHallway = defaultRoom->IsConnectedToHallway;
+
+	if(RoomRoot && hasDefaultRootScale)
+	{
+		RoomRoot->SetRelativeScale3D(defaultRootScale);
+	}
+}
+
+/*
+ * @brief Limit the network relevancy of the room to the floors around it
+ * @param const FVector& location of the room
+ * @param float floorHeight Height of a floor, 0 disables the floor relevancy
+ * @param int floorRange Number of floors above and below the viewer
+ */
+void AMainRoom::SetFloorRelevancy(const FVector& location, float floorHeight, int floorRange)
+{
+	RelevancyFloorHeight = floorHeight;
+	RelevantFloorRange = floorRange;
+	RelevancyFloor = floorHeight > 0.0f ? GetFloorNumber(location, floorHeight) : 0;
+}
+
+/*
+ * @brief Get the floor of a location, the location is snapped to the grid first
+ * @param const FVector& location
+ * @param float floorHeight Height of a floor, the dungeon unit
+ * @return int Floor number, the basement takes the first three units
+ */
+int AMainRoom::GetFloorNumber(const FVector& location, float floorHeight)
+{
+	const FVector pos = location.GridSnap(floorHeight);
+	return (pos.Z - floorHeight * 3) / floorHeight;
+}
+
+/*
+ * @brief Check if the room is relevant for a viewer
+ * Comparing floors is a lot cheaper than the distance and visibility checks, so far floors are rejected first.
+ * @param const AActor* RealViewer
+ * @param const AActor* ViewTarget
+ * @param const FVector& SrcLocation Location of the viewer
+ * @return bool True if the room should be replicated to the viewer
+ */
+bool AMainRoom::IsNetRelevantFor(const AActor* RealViewer, const AActor* ViewTarget, const FVector& SrcLocation) const
+{
+	if(RelevancyFloorHeight > 0.0f && !bAlwaysRelevant)
+	{
+		const int viewerFloor = GetFloorNumber(SrcLocation, RelevancyFloorHeight);
+		if(FMath::Abs(viewerFloor - RelevancyFloor) > RelevantFloorRange)
+			return false;
+	}
+	
+	return Super::IsNetRelevantFor(RealViewer, ViewTarget, SrcLocation);
+}
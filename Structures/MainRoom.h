@@ -21,10 +21,17 @@ protected:
 	virtual void BeginPlay() override;
 
 	UNavModifierComponent* navModifier;
+
+	// Scale of the root before InitInfo changed it
+	FVector defaultRootScale = FVector::OneVector;
+	bool hasDefaultRootScale = false;
 		
 public:	
 	// Called every frame
 	virtual void Tick(float DeltaTime) override;
+
+	// Skip connections whose viewer is too many floors away
+	virtual bool IsNetRelevantFor(const AActor* RealViewer, const AActor* ViewTarget, const FVector& SrcLocation) const override;
 	
 	UFUNCTION(BlueprintCallable)
 	void SetExitPoints(TArray<UArrowComponent*> exits);
@@ -46,6 +53,16 @@ public:
 
 	UFUNCTION(BlueprintCallable)
 	void InitInfo(const FTransform& transform, const FVector& size, const FBox& bounds);
+
+	// Restore the room information of the class defaults, used when a parked room is reused
+	UFUNCTION(BlueprintCallable)
+	void ResetInfo();
+
+	UFUNCTION(BlueprintCallable)
+	void SetFloorRelevancy(const FVector& location, float floorHeight, int floorRange);
+
+	// Floor of a location in a dungeon with floors of the given height, the floors below the ground floor are negative
+	static int GetFloorNumber(const FVector& location, float floorHeight);
 	
 
 	// ====== Properties ======
@@ -75,4 +92,19 @@ public:
 
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, meta=(AllowPrivateAccess="true"))
 	bool IsConnectedToHallway = false;
+
+	// Height of a floor for network relevancy, 0 makes the room relevant on every floor
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, meta=(AllowPrivateAccess="true"))
+	float RelevancyFloorHeight = 0.0f;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, meta=(AllowPrivateAccess="true"))
+	int RelevancyFloor = 0;
+
+	// Number of floors above and below the viewer the room stays relevant
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, meta=(AllowPrivateAccess="true"))
+	int RelevantFloorRange = 1;
+
+	// Keep this prefab as an actor when the dungeon is built from instanced meshes
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(AllowPrivateAccess="true"))
+	bool HasGameplayLogic = false;
 };